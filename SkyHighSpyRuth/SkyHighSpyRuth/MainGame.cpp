@@ -5,6 +5,8 @@
 constexpr int DISPLAY_WIDTH = 1280;
 constexpr int DISPLAY_HEIGHT = 720;
 constexpr int DISPLAY_SCALE = 1;
+constexpr int RESERVE_GAME_OBJECTS = 1024; //Rocks, gems and pieces all come from this pool
+constexpr int TRAIL_PARTICLES = 64; //The trail's oldest particles are replaced once there are this many
 constexpr int origin_offset_y = 15;
 
 enum Types
@@ -18,7 +20,6 @@ enum Types
 	TYPE_RING,
 	TYPE_ATTACHED,
 	TYPE_WAITING,
-	TYPE_PARTICLES,
 };
 
 enum Agent8States
@@ -36,10 +37,14 @@ struct GameState
 	int startingLevel = 2;
 	int gemNumber = startingLevel / 2;
 	int gemsSpawned = 0;
+	int trailEmitter = -1;
+	std::vector<int> gemRocks; //Ids of the asteroids which leave a gem behind
 };
 
 GameState gameState;
 
+void SimulateGame();
+void DrawGame();
 void UpdateRock();
 void WrapMovement(GameObject& object);
 void UpdateAgent();
@@ -57,12 +62,12 @@ void UpdateGems();
 void Restart(int level);
 void UpdateRings();
 void SpawnParticles();
-void UpdateParticles();
 
 // The entry point for a PlayBuffer program
 void MainGameEntry(PLAY_IGNORE_COMMAND_LINE)
 {
-	Play::CreateManager(DISPLAY_WIDTH, DISPLAY_HEIGHT, DISPLAY_SCALE);
+	Play::CreateManager(DISPLAY_WIDTH, DISPLAY_HEIGHT, DISPLAY_SCALE, RESERVE_GAME_OBJECTS);
+	Play::SetPipelinedDrawing(true);
 	Play::CentreAllSpriteOrigins();
 	Play::LoadBackground("Data\\Backgrounds\\background.png");
 	Play::StartAudioLoop("music");
@@ -77,6 +82,14 @@ void MainGameEntry(PLAY_IGNORE_COMMAND_LINE)
 	//The asteroid's sprite has a small tail so origin also needs to move along y so it is in the centre of the asteroid itself
 	Play::MoveSpriteOrigin("asteroid_2", 0, 1 - origin_offset_y);
 
+	//Agent8's trail - each particle shrinks and fades from full size to 4% over 48 steps before it disappears
+	ParticleSettings trail;
+	trail.lifetime = 48.0f / FRAMES_PER_SECOND;
+	trail.scale = { 1.0f, 0.04f };
+	trail.alpha = { 1.0f, 0.04f };
+	trail.spread = { 2.0f, 2.0f };
+	gameState.trailEmitter = Play::CreateParticleEmitter("particle", TRAIL_PARTICLES, trail);
+
 	//Platforms and hazards - no. of both depends on gamestate level so takes it as an argument
 	SpawnRocks(gameState.startingLevel);
 	SpawnMeteors(gameState.startingLevel);
@@ -85,13 +98,26 @@ void MainGameEntry(PLAY_IGNORE_COMMAND_LINE)
 // Called by PlayBuffer every frame (60 times a second!)
 bool MainGameUpdate( float elapsedTime )
 {
-	Play::DrawBackground();
+	//Gameplay runs in fixed 1/60s steps so its speed doesn't depend on the frame rate - there may be none or several per frame
+	for (int steps = Play::AccumulateFixedSteps(elapsedTime); steps > 0; steps--)
+	{
+		SimulateGame();
+	}
+
+	//Drawing happens once per frame, with objects drawn part way between their last two steps
+	DrawGame();
+	Play::PresentDrawingBuffer();
+	return Play::KeyDown( VK_ESCAPE );
+}
+
+void SimulateGame()
+{
 	UpdateRock();
 	UpdateAgent();
 	UpdatePieces();
 	UpdateGems();
 	UpdateRings();
-	UpdateParticles();
+	Play::UpdateParticles(1.0f / FRAMES_PER_SECOND);
 
 	//Next level
 	if (gameState.score == gameState.gemNumber)
@@ -101,12 +127,48 @@ bool MainGameUpdate( float elapsedTime )
 		Play::PlayAudio("reward");
 		Restart(gameState.startingLevel);
 	}
-	Play::PresentDrawingBuffer();
-	return Play::KeyDown( VK_ESCAPE );
+}
+
+void DrawGame()
+{
+	Play::DrawBackground();
+
+	//Rocks, including the one agent8 is attached to
+	for (int type : { TYPE_ASTEROID, TYPE_METEOR, TYPE_ATTACHED })
+	{
+		for (int id : Play::GetGameObjectIDsByType(type))
+		{
+			Play::DrawObjectRotated(Play::GetGameObject(id));
+		}
+	}
+
+	//Instructions
+	if (gameState.agentStates == STATE_START)
+	{
+		Play::DrawFontText("151px", "Level " + std::to_string(gameState.startingLevel - 1), { DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2 }, Play::CENTRE);
+		Play::DrawFontText("64px", "Collect " + std::to_string(gameState.gemNumber) + " gem(s)", { DISPLAY_WIDTH / 2 - 17, DISPLAY_HEIGHT / 2 + 100 }, Play::CENTRE);
+		Play::DrawFontText("64px", "Left and right keys to move, spacebar to jump", { DISPLAY_WIDTH / 2, DISPLAY_HEIGHT - 50 }, Play::CENTRE);
+	}
+
+	//Agent and score UI
+	Play::DrawObjectRotated(Play::GetGameObjectByType(TYPE_AGENT8));
+	Play::DrawFontText("105px", "Gems = " + std::to_string(gameState.score), { 50,50 }, Play::LEFT);
+
+	//Gems-in-waiting aren't drawn until they can be collected
+	for (int type : { TYPE_PIECES, TYPE_GEM, TYPE_RING })
+	{
+		for (int id : Play::GetGameObjectIDsByType(type))
+		{
+			Play::DrawObjectRotated(Play::GetGameObject(id));
+		}
+	}
+
+	Play::DrawParticles(gameState.trailEmitter);
 }
 
 void SpawnRocks(int level)
 {
+	gameState.gemRocks.clear();
 	//Same no. of asteroids as the level
 	for (int i = 1; i <= level; i++)
 	{
@@ -120,13 +182,19 @@ void SpawnRocks(int level)
 		GameObject& obj_rock = Play::GetGameObject(id_rock);
 		obj_rock.rotation = rotation;
 		obj_rock.animSpeed = 0.05;
+
+		//Every other asteroid spawned leaves a gem, so there are always at least level / 2 of them
+		if (i % 2)
+		{
+			gameState.gemRocks.push_back(id_rock);
+		}
 	}
 	std::vector<int> vRocks = Play::CollectGameObjectIDsByType(TYPE_ASTEROID);
 
 	//Randomly choose one for Agent8 to start on by randomly choosing index of vector and changing type of object there
 	int id_attached = Play::RandomRollRange(0, vRocks.size() -1);
 	GameObject& obj_attached = Play::GetGameObject(vRocks.at(id_attached));
-	obj_attached.type = TYPE_ATTACHED;
+	Play::SetGameObjectType(obj_attached, TYPE_ATTACHED);
 }
 
 void SpawnMeteors(int level)
@@ -146,36 +214,27 @@ void SpawnMeteors(int level)
 
 		//When spawned, check it isn't overlapping with any of the other asteroids
 		//If deadly asteroid is overlapping with an asteroid can create impossible situation for player
-		std::vector<int> vRocks = Play::CollectGameObjectIDsByType(TYPE_ASTEROID);
-		GameObject& obj_attached = Play::GetGameObjectByType(TYPE_ATTACHED);
-		for (int id : vRocks)
+		//Only nudged as many times as there are asteroids, like checking each asteroid in turn
+		int nudges = (int)Play::GetGameObjectIDsByType(TYPE_ASTEROID).size();
+		while (nudges-- > 0 && !Play::QueryCollisions(obj_meteor, (1 << TYPE_ASTEROID) | (1 << TYPE_ATTACHED)).empty())
 		{
-			GameObject& obj_rock = Play::GetGameObject(id);
-			if (Play::IsColliding(obj_meteor, obj_rock) || Play::IsColliding(obj_meteor, obj_attached))
-			{
-				//If overlapping then shifts position along the path determined by its rotation
-				obj_meteor.pos.x += 20 * sin(obj_meteor.rotation);
-				obj_meteor.pos.y += 20 * -cos(obj_meteor.rotation);
-			}
+			//If overlapping then shifts position along the path determined by its rotation
+			obj_meteor.pos.x += 20 * sin(obj_meteor.rotation);
+			obj_meteor.pos.y += 20 * -cos(obj_meteor.rotation);
+			Play::MarkGameObjectMoved(obj_meteor);
 		}
 	}
 }
 
 void UpdateRock()
 {
-	//Both asteroids and meteors have same update method so consolidated code into one function and used 2D vector
-	std::vector<std::vector<int>> vRocks =
+	//Both asteroids and meteors have same update method so consolidated code into one function and looped over both types
+	for (int type : { TYPE_ASTEROID, TYPE_METEOR })
 	{
-		{ Play::CollectGameObjectIDsByType(TYPE_ASTEROID) },
-		{ Play::CollectGameObjectIDsByType(TYPE_METEOR) }
-	};
-	for (std::vector<int> vec : vRocks)
-	{
-		for (int id : vec)
+		for (int id : Play::GetGameObjectIDsByType(type))
 		{
 			//Movement
 			GameObject& obj_rock = Play::GetGameObject(id);
-			Play::DrawObjectRotated(obj_rock);
 			Play::SetGameObjectDirection(obj_rock, 4, obj_rock.rotation);
 
 			if (Play::IsLeavingDisplayArea(obj_rock))
@@ -216,20 +275,14 @@ void UpdateAgent()
 
 			break;
 	}
-	//Implements any changes from state by updating game object and drawing to buffer 
+	//Implements any changes from state by updating game object
 	Play::UpdateGameObject(obj_agent);
-	Play::DrawObjectRotated(obj_agent);
-	//score UI updated here since it's in StateFlying that score may change
-	Play::DrawFontText("105px", "Gems = " + std::to_string(gameState.score), { 50,50 }, Play::LEFT);
 }
 
 void StateFlying()
 {
 	//Variables - references to agent and any objects it may collide with
 	GameObject& obj_agent = Play::GetGameObjectByType(TYPE_AGENT8);
-	std::vector<int> vRocks = Play::CollectGameObjectIDsByType(TYPE_ASTEROID);
-	std::vector<int> vMeteors = Play::CollectGameObjectIDsByType(TYPE_METEOR);
-	std::vector<int> vGems = Play::CollectGameObjectIDsByType(TYPE_GEM); //In case there are multiple gems at once
 
 	//Movement
 	Play::SetSprite(obj_agent, "agent8_fly", 1);
@@ -252,47 +305,37 @@ void StateFlying()
 		WrapMovement(obj_agent);
 	}
 
-	//Landing on another asteroid
-	for (int id : vRocks)
+	//Landing on another asteroid - only the asteroids near the agent are checked
+	for (int id : Play::QueryCollisions(obj_agent, 1 << TYPE_ASTEROID))
 	{
+		//If it collides with any asteroid, that asteroid becomes TYPE_ATTACHED so it can be referenced, and state changes
 		GameObject& obj_rock = Play::GetGameObject(id);
-		if (Play::IsColliding(obj_agent, obj_rock))
-		{
-			//If it collides with any asteroid in vector, that asteroid becomes TYPE_ATTACHED so it can be referenced, and state changes
-			gameState.agentStates = STATE_ATTACHED;
-			Play::SetSprite(obj_agent, "agent8_left_7", 0);
-			obj_rock.type = TYPE_ATTACHED;
-			//Agent8 is pointed towards old position so it lands on the side of the asteroid it collided with
-			Play::PointGameObject(obj_agent, 0, obj_agent.oldPos.x, obj_agent.oldPos.y);
-		}
+		gameState.agentStates = STATE_ATTACHED;
+		Play::SetSprite(obj_agent, "agent8_left_7", 0);
+		Play::SetGameObjectType(obj_rock, TYPE_ATTACHED);
+		//Agent8 is pointed towards old position so it lands on the side of the asteroid it collided with
+		Play::PointGameObject(obj_agent, 0, obj_agent.oldPos.x, obj_agent.oldPos.y);
 	}
 
 	//Hitting a deadly meteor
-	for (int id : vMeteors)
+	if (!Play::QueryCollisions(obj_agent, 1 << TYPE_METEOR).empty())
 	{
-		GameObject& obj_meteor = Play::GetGameObject(id);
-		if (Play::IsColliding(obj_agent, obj_meteor))
-		{
-			Play::PlayAudio("combust");
-			gameState.agentStates = STATE_DEAD;
-		}
+		Play::PlayAudio("combust");
+		gameState.agentStates = STATE_DEAD;
 	}
 
-	//Collecting gems
-	for (int id : vGems)
+	//Collecting gems - in case there are multiple gems at once
+	for (int id : Play::QueryCollisions(obj_agent, 1 << TYPE_GEM))
 	{
 		GameObject& obj_gem = Play::GetGameObject(id);
-		if (Play::IsColliding(obj_agent, obj_gem))
-		{
-			gameState.score++;
-			Play::PlayAudio("collect");
-			//Ring particle effect spawned
-			int id_ring = Play::CreateGameObject(TYPE_RING, obj_gem.pos, 0, "blue_ring");
-			GameObject& obj_ring = Play::GetGameObject(id_ring);
-			obj_ring.scale = 0.25;
-			//Destroys gem - must happen last
-			Play::DestroyGameObject(id);
-		}
+		gameState.score++;
+		Play::PlayAudio("collect");
+		//Ring particle effect spawned
+		int id_ring = Play::CreateGameObject(TYPE_RING, obj_gem.pos, 0, "blue_ring");
+		GameObject& obj_ring = Play::GetGameObject(id_ring);
+		obj_ring.scale = 0.25;
+		//Destroys gem - must happen last
+		Play::DestroyGameObject(id);
 	}
 }
 
@@ -332,6 +375,7 @@ void StateAttached()
 		//Movement set depending on inital rotation
 		obj_agent.pos.x = obj_agent.pos.x + 20 * sin(obj_agent.rotation);
 		obj_agent.pos.y = obj_agent.pos.y + 20 * -cos(obj_agent.rotation);
+		Play::MarkGameObjectMoved(obj_agent);
 		obj_agent.animSpeed = 0.1;
 		//Spawn functions called using copy of attached obj/id, then asteroid destroyed
 		SpawnPieces(obj_attached);
@@ -368,11 +412,6 @@ void StateStart()
 	obj_agent.rotSpeed = 0;
 	Play::SetSprite(obj_agent, "agent8_left_7", 0);
 
-	//Instructions
-	Play::DrawFontText("151px", "Level " + std::to_string(gameState.startingLevel - 1), { DISPLAY_WIDTH / 2, DISPLAY_HEIGHT / 2 }, Play::CENTRE);
-	Play::DrawFontText("64px", "Collect " + std::to_string(gameState.gemNumber) + " gem(s)", { DISPLAY_WIDTH / 2 - 17, DISPLAY_HEIGHT / 2 + 100 }, Play::CENTRE);
-	Play::DrawFontText("64px", "Left and right keys to move, spacebar to jump", { DISPLAY_WIDTH / 2, DISPLAY_HEIGHT - 50 }, Play::CENTRE);
-	
 	//Start Game when spacebar pressed
 	if (Play::KeyPressed(VK_SPACE))
 	{
@@ -387,18 +426,20 @@ void AgentAttached()
 	GameObject& obj_attached = Play::GetGameObjectByType(TYPE_ATTACHED);
 	int id_attached = obj_attached.GetId();
 
+	//Wrap before moving, like UpdateRock(), so the asteroid and agent8 aren't drawn part way across the screen
+	if (Play::IsLeavingDisplayArea(obj_attached))
+	{
+		WrapMovement(obj_attached);
+	}
+
 	//Attach to asteroid by setting position and velocity
 	obj_agent.pos = obj_attached.pos;
+	Play::MarkGameObjectMoved(obj_agent);
 	Play::SetGameObjectDirection(obj_attached, 4, obj_attached.rotation);
 	obj_agent.velocity = obj_attached.velocity;
 
 	//Update attached asteroid here because it will no longer be included in UpdateRocks()
 	Play::UpdateGameObject(obj_attached);
-	Play::DrawObjectRotated(obj_attached);
-	if (Play::IsLeavingDisplayArea(obj_attached))
-	{
-		WrapMovement(obj_attached);
-	}
 }
 
 void SpawnPieces(GameObject& object)
@@ -426,7 +467,6 @@ void UpdatePieces()
 	for (int id : vPieces)
 	{
 		GameObject& obj_piece = Play::GetGameObject(id);
-		Play::DrawObjectRotated(obj_piece);
 		Play::UpdateGameObject(obj_piece);
 		if (!Play::IsVisible(obj_piece))
 		{
@@ -441,9 +481,9 @@ void SpawnGems(int id_rock)
 	//Only spawn new gem if total number of gems for level isn't yet reached
 	if (gameState.gemsSpawned < gameState.gemNumber)
 	{
-		//Only spawn gem for odd number asteroids
+		//Only spawn gem for every other asteroid spawned (ids can't be used as freed ids are reused in any order)
 		//Adds randomness to gem spawns without risk of not enough gems spawning in level
-		if (id_rock % 2)
+		if (std::find(gameState.gemRocks.begin(), gameState.gemRocks.end(), id_rock) != gameState.gemRocks.end())
 		{
 			//When first spawned given TYPE_WAITING so player doesn't immediately collide with and collect gem
 			int id_gem = Play::CreateGameObject(TYPE_WAITING, obj_rock.pos, 20, "gem");
@@ -485,7 +525,7 @@ void UpdateGems()
 		//Delay before allowing agent collision - use frame as timer as this reliably increases every other frame (animSpeed = 0.5)
 		if (obj_waiting.frame == 10)
 		{
-			obj_waiting.type = TYPE_GEM;
+			Play::SetGameObjectType(obj_waiting, TYPE_GEM);
 			//No longer needs animation speed - animation relies on rotation instead
 			obj_waiting.animSpeed = 0;
 			obj_waiting.rotSpeed = 0.05;
@@ -494,11 +534,9 @@ void UpdateGems()
 
 
 	//Update gems
-	std::vector<int> vGems = Play::CollectGameObjectIDsByType(TYPE_GEM);
-	for (int id : vGems)
+	for (int id : Play::GetGameObjectIDsByType(TYPE_GEM))
 	{
 		GameObject& obj_gem = Play::GetGameObject(id);
-		Play::DrawObjectRotated(obj_gem);
 		Play::UpdateGameObject(obj_gem);
 
 		//Animation
@@ -527,6 +565,8 @@ void WrapMovement(GameObject& object) //Wrap around display area when out of sig
 	{
 		object.pos.y += object.oldPos.y * -1 + DISPLAY_HEIGHT;
 	}
+	//Position was changed directly, so collision checks need to know
+	Play::MarkGameObjectMoved(object);
 }
 
 void UpdateRings()
@@ -537,7 +577,6 @@ void UpdateRings()
 		GameObject& obj_ring = Play::GetGameObject(id);
 		obj_ring.scale += 0.1;
 		Play::UpdateGameObject(obj_ring);
-		Play::DrawObjectRotated(obj_ring);
 		if (obj_ring.scale >= 1.5)
 		{
 			Play::DestroyGameObject(id);
@@ -547,26 +586,9 @@ void UpdateRings()
 
 void SpawnParticles()
 {
+	//Particles land up to 2 pixels either side of 3 pixels from where agent8 was
 	GameObject& obj_agent = Play::GetGameObjectByType(TYPE_AGENT8);
-	int posOffset_x = Play::RandomRoll(5);
-	int posOffset_y = Play::RandomRoll(5);
-	int id_particles = Play::CreateGameObject(TYPE_PARTICLES, { obj_agent.oldPos.x + posOffset_x, obj_agent.oldPos.y + posOffset_y }, 0, "particle");
-}
-
-void UpdateParticles()
-{
-	std::vector<int> vParticles = Play::CollectGameObjectIDsByType(TYPE_PARTICLES);
-	for (int id : vParticles)
-	{
-		GameObject& obj_particles = Play::GetGameObject(id);
-		obj_particles.scale -= 0.02;
-		Play::UpdateGameObject(obj_particles);
-		Play::DrawObjectRotated(obj_particles, obj_particles.scale);
-		if (obj_particles.scale <= 0.05)
-		{
-			Play::DestroyGameObject(id);
-		}
-	}
+	Play::EmitParticles(gameState.trailEmitter, { obj_agent.oldPos.x + 3, obj_agent.oldPos.y + 3 });
 }
 
 void Restart(int level)
@@ -33,7 +33,9 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <deque>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <chrono>
 #include <iostream>
@@ -41,6 +43,14 @@
 #include <filesystem>
 #include <thread>
 #include <future>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Define PLAY_HEADLESS before including Play.h to build without a window on any platform (e.g. Linux build servers)
+// > The game loop runs at full speed with scripted input, PNGs are loaded with a built-in decoder and audio is silent
+#ifndef PLAY_HEADLESS
 
 #define WIN32_LEAN_AND_MEAN // Exclude rarely-used content from the Windows headers
 #define NOMINMAX // Stop windows macros defining their own min and max macros
@@ -67,6 +77,48 @@ namespace Gdiplus
 #include <GdiPlus.h>
 #pragma warning(pop)
 
+#else
+
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+
+#ifndef UNREFERENCED_PARAMETER
+#define UNREFERENCED_PARAMETER( P ) (void)( P )
+#endif
+
+// The Windows virtual key codes used for keyboard input
+enum PlayVirtualKey
+{
+	VK_BACK = 0x08, VK_TAB = 0x09, VK_RETURN = 0x0D, VK_SHIFT = 0x10, VK_CONTROL = 0x11, VK_ESCAPE = 0x1B, VK_SPACE = 0x20,
+	VK_LEFT = 0x25, VK_UP = 0x26, VK_RIGHT = 0x27, VK_DOWN = 0x28,
+	VK_F1 = 0x70, VK_F2 = 0x71, VK_F3 = 0x72, VK_F4 = 0x73, VK_F5 = 0x74, VK_F6 = 0x75,
+	VK_F7 = 0x76, VK_F8 = 0x77, VK_F9 = 0x78, VK_F10 = 0x79, VK_F11 = 0x7A, VK_F12 = 0x7B,
+};
+
+#endif // PLAY_HEADLESS
+
+// SIMD intrinsics for the blitter kernels on x86/x64 (SSE2 is always available there, AVX2 is detected at runtime)
+// > Define PLAY_NO_SIMD before including Play.h to force the scalar kernels
+// > GCC and Clang only allow AVX2 intrinsics in functions marked with PLAY_TARGET_AVX2
+#if !defined(PLAY_NO_SIMD) && ( defined(_M_IX86) || defined(_M_X64) )
+#define PLAY_SIMD
+#define PLAY_TARGET_AVX2
+#include <intrin.h>
+#elif !defined(PLAY_NO_SIMD) && defined(__GNUC__) && ( defined(__i386__) || defined(__x86_64__) ) && defined(__SSE2__)
+#define PLAY_SIMD
+#define PLAY_SIMD_GNU
+#define PLAY_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+
+#ifdef _MSC_VER
+#define PLAY_DEBUG_BREAK() __debugbreak()
+#else
+#define PLAY_DEBUG_BREAK() __builtin_trap()
+#endif
+
 // Macros for Assertion and Tracing
 void TracePrintf(const char* file, int line, const char* fmt, ...);
 void AssertFailMessage(const char* message, const char* file, long line );
@@ -74,11 +126,11 @@ void DebugOutput( const char* s );
 void DebugOutput( std::string s );
 
 #ifdef _DEBUG
-#define PLAY_TRACE(fmt, ...) TracePrintf(__FILE__, __LINE__, fmt, __VA_ARGS__);
-#define PLAY_ASSERT(x) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(#x, __FILE__, __LINE__), __debugbreak(); }
-#define PLAY_ASSERT_MSG(x,y) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(y, __FILE__, __LINE__), __debugbreak(); }
+#define PLAY_TRACE(...) TracePrintf(__FILE__, __LINE__, __VA_ARGS__);
+#define PLAY_ASSERT(x) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(#x, __FILE__, __LINE__), PLAY_DEBUG_BREAK(); }
+#define PLAY_ASSERT_MSG(x,y) if(!(x)){ PLAY_TRACE(" *** ASSERT FAIL *** !("#x")\n\n"); AssertFailMessage(y, __FILE__, __LINE__), PLAY_DEBUG_BREAK(); }
 #else
-#define PLAY_TRACE(fmt, ...)
+#define PLAY_TRACE(...)
 #define PLAY_ASSERT(x) if(!(x)){ AssertFailMessage(#x, __FILE__, __LINE__);  }
 #define PLAY_ASSERT_MSG(x,y) if(!(x)){ AssertFailMessage(y, __FILE__, __LINE__); }
 #endif // _DEBUG
@@ -456,11 +508,11 @@ struct MouseData
 //********************************************************************************************************************************
 // File:		PlayWindow.h
 // Description:	Platform specific code to provide a window to draw into
-// Platform:	Windows
+// Platform:	Windows, or any platform with PLAY_HEADLESS
 // Notes:		Uses a 32-bit ARGB display buffer
 //********************************************************************************************************************************
 
-// The target frame rate
+// The default target frame rate
 constexpr int FRAMES_PER_SECOND = 60;
 
 // Some defines to hide the complexity of arguments 
@@ -485,6 +537,7 @@ public:
 	// Destroys the PlayWindow instance
 	static void Destroy();
 
+#ifndef PLAY_HEADLESS
 	// Windows functions
 	//********************************************************************************************************************************
 
@@ -492,11 +545,43 @@ public:
 	int HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLine, int nCmdShow, LPCWSTR windowName );
 	// Handles Windows messages for the PlayWindow  
 	static LRESULT CALLBACK WndProc( HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam );
-	// Copies the display buffer pixels to the window
+#else
+	// Headless functions
+	//********************************************************************************************************************************
+
+	// Called from main to run the game loop at full speed until MainGameUpdate returns true or the frame limit is reached
+	int HandleHeadless();
+	// Sets the number of frames to run before quitting (0 runs until MainGameUpdate returns true)
+	void SetFrameLimit( int frames ) { m_frameLimit = frames; }
+	// Replaces the clock which gives the elapsed time passed to MainGameUpdate for each frame
+	// > The default clock returns exactly 1/FRAMES_PER_SECOND so runs are repeatable
+	void SetClock( std::function<float( int frame )> clock ) { m_clock = clock; }
+	// Queues a key press or release for the start of the given frame
+	void ScriptKey( int frame, int vKey, bool down );
+	// Queues a mouse position and button state for the start of the given frame
+	void ScriptMouse( int frame, Vector2f pos, bool left, bool right );
+	// Loads scripted input from a text file with one event per line: "<frame> key <vKey> <0|1>" or "<frame> mouse <x> <y> <0|1> <0|1>"
+	// > Returns false if the file couldn't be opened
+	bool LoadInputScript( const char* filename );
+	// Sets a function to be given the display buffer and the number of frames presented before it each time it is presented
+	// > With pipelined drawing it is called on the render thread, while the game is updating the next frame
+	void SetPresentCallback( std::function<void( const PixelData& buffer, int frame )> callback ) { m_presentCallback = callback; }
+	// Checks whether the key is held down in the scripted input
+	bool IsKeyDown( int vKey ) const { return vKey >= 0 && vKey < 256 && m_keyDown[vKey]; }
+	// Gets the display buffer so its pixels can be inspected
+	const PixelData& GetPlayBuffer() const { return *m_pPlayBuffer; }
+	// Gets the number of the current frame
+	int GetFrame() const { return m_frame; }
+#endif
+	// Copies the rows of the display buffer from top to bottom (exclusive) to the window, or all of them if bottom is -1
+	// > The whole buffer is copied when the window needs repainting. Headless builds always pass the whole buffer on.
 	// > Returns the time taken for the present in seconds
-	double Present();
+	double Present( int top = 0, int bottom = -1 );
 	// Sets the pointer to write mouse input data to
 	void RegisterMouse( MouseData* pMouseData ) { m_pMouseData = pMouseData; }
+	// Sets the frame rate the game loop is paced to, or 0 to run uncapped for benchmarking
+	// > Headless builds always run uncapped
+	void SetTargetFrameRate( int framesPerSecond ) { PLAY_ASSERT( framesPerSecond >= 0 ); m_targetFrameRate = framesPerSecond; }
 
 	// Getter functions
 	//********************************************************************************************************************************
@@ -535,6 +620,8 @@ private:
 
 	// Display buffer dimensions
 	int m_scale{ 0 };
+	// Frames per second for the frame pacer (0 is uncapped)
+	int m_targetFrameRate{ FRAMES_PER_SECOND };
 
 	// Buffer pointers
 	PixelData* m_pPlayBuffer{ nullptr };
@@ -542,12 +629,42 @@ private:
 	MouseData* m_pMouseData{ nullptr };
 	// Pointer to the instance.
 	static PlayWindow* s_pInstance;
+#ifndef PLAY_HEADLESS
 	// The handle to the Window 
 	HWND m_hWindow{ nullptr };
 	// A GDI+ token
 	static unsigned long long s_pGDIToken;
+	// Set when the window has to be repainted, so the next present copies the whole display buffer
+	std::atomic<bool> m_bFullPresent{ true };
+#else
+	// A scripted keyboard or mouse event
+	struct ScriptedInput
+	{
+		int frame{ 0 };
+		bool isMouse{ false };
+		int vKey{ 0 };
+		bool down{ false };
+		MouseData mouse;
+	};
+
+	// Applies all of the scripted input due at the start of the current frame
+	void ApplyScriptedInput();
+
+	int m_frame{ 0 };
+	int m_presentedFrames{ 0 }; // Counted separately as frames can be presented on the render thread
+	int m_frameLimit{ 0 };
+	std::function<float( int )> m_clock;
+	std::function<void( const PixelData&, int )> m_presentCallback;
+	std::vector<ScriptedInput> m_vScriptedInput; // Kept in frame order
+	size_t m_nextInput{ 0 };
+	bool m_keyDown[256]{};
+#endif
 };
 
+// Converts a path used by the game into one the platform can open
+// > Headless builds swap backslashes for forward slashes and match each directory and file name without regard to case
+std::string PlayNativePath( const std::string& path );
+
 #endif
 
 
@@ -560,6 +677,21 @@ private:
 // Platform:	Independent
 //********************************************************************************************************************************
 
+// A horizontal run of visible pixels within one row of pre-multiplied pixel data
+struct PixelSpan
+{
+	uint16_t start{ 0 }; // Offset of the first pixel from the start of the row
+	uint16_t length{ 0 }; // Number of pixels in the run
+	bool opaque{ false }; // Every pixel in the run is fully opaque so it can be copied without blending
+};
+
+// The runs of visible pixels in each row of a block of pre-multiplied pixel data (fully-transparent pixels are left out)
+struct SpanList
+{
+	std::vector<PixelSpan> spans; // All of the spans, in row order
+	std::vector<int> rowStart; // The index in spans of each row's first span (height + 1 entries)
+};
+
 // A software pixel renderer for drawing 2D primitives into a PixelData buffer
 // > A singleton class accessed using PlayBlitter::Instance()
 class PlayBlitter
@@ -571,31 +703,96 @@ public:
 
 	// Constructor
 	PlayBlitter( PixelData* pRenderTarget = nullptr );
-	// Set the render target for all subsequent drawing operations
+	// Set the render target for all subsequent drawing operations (also resets the clipping rectangle to the whole target)
 	// Returns a pointer to any previous render target
-	PixelData* SetRenderTarget( PixelData* pRenderTarget ) { PixelData* old = m_pRenderTarget; m_pRenderTarget = pRenderTarget; return old; }
+	PixelData* SetRenderTarget( PixelData* pRenderTarget ) { PixelData* old = m_pRenderTarget; m_pRenderTarget = pRenderTarget; ResetClipRect(); return old; }
+	// Gets the current render target
+	PixelData* GetRenderTarget() const { return m_pRenderTarget; }
+	// Restricts all subsequent drawing operations to a rectangle within the render target (right and bottom are exclusive)
+	void SetClipRect( int left, int top, int right, int bottom );
+	// Allows drawing operations to cover the whole render target again
+	void ResetClipRect();
+
+	// How drawn pixels are combined with the pixels already in the render target
+	enum BlendMode
+	{
+		BLEND_NORMAL = 0, // Pixels are blended over the render target using their alpha
+		BLEND_ADDITIVE, // Pixels are multiplied by their alpha and added to the render target, saturating at white
+	};
 
 	// Primitive drawing functions
 	//********************************************************************************************************************************
 
 	// Sets the colour of an individual pixel on the render target
-	void DrawPixel( int posX, int posY, Pixel pix );
+	void DrawPixel( int posX, int posY, Pixel pix ) const;
 	// Draws a line of pixels into the render target
-	void DrawLine( int startX, int startY, int endX, int endY, Pixel pix );
+	// > Only the part of the line within the clipping rectangle is visited, and clipping doesn't change which pixels are drawn
+	void DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) const;
+	// Fills a rectangle of the render target with a colour, blending it if it's translucent (right and bottom are exclusive)
+	void FillRect( int left, int top, int right, int bottom, Pixel pix ) const;
+	// Draws the outline of a circle into the render target
+	void DrawCircle( int centreX, int centreY, int radius, Pixel pix ) const;
 	// Draws pixel data to the render target using a direct copy
 	// > Setting alphaMultiply < 1 forces a less optimal rendering approach (~50% slower) 
 	void BlitPixels( const PixelData& srcImage, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const;
-	// Draws rotated and scaled pixel data to the render target (much slower than BlitPixels)
-	// > Setting alphaMultiply isn't a signfiicant additional slow down on RotateScalePixels
-	void RotateScalePixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, int originX, int originY, float angle, float scale, float alphaMultiply = 1.0f ) const;
+	// Draws pre-multiplied pixel data to the render target visiting only the pixels in its span list
+	// > Opaque spans are copied and transparent areas are never read, so this is the fastest way to draw sparse images
+	// > The pixels are multiplied by the tint colour as they are drawn (white leaves them unchanged at no extra cost)
+	void BlitPixels( const PixelData& srcImage, int srcOffset, const SpanList& spanList, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply, Pixel tint = PIX_WHITE, BlendMode blendMode = BLEND_NORMAL ) const;
+	// Draws rotated and scaled pixel data to the render target (slower than BlitPixels)
+	// > Setting alphaMultiply isn't a signfiicant additional slow down on RotateScalePixels, and neither is a tint
+	void RotateScalePixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, int originX, int originY, float angle, float scale, float alphaMultiply = 1.0f, Pixel tint = PIX_WHITE, BlendMode blendMode = BLEND_NORMAL ) const;
 	// Clears the render target using the given pixel colour
-	void ClearRenderTarget( Pixel colour );
+	void ClearRenderTarget( Pixel colour ) const;
 	// Copies a background image of the correct size to the render target
-	void BlitBackground( PixelData& backgroundImage );
+	void BlitBackground( const PixelData& backgroundImage ) const;
+	// Finds the runs of opaque and translucent pixels in a block of pre-multiplied pixel data, ready for drawing with BlitPixels
+	static void BuildSpanList( const PixelData& srcImage, int srcOffset, int width, int height, SpanList& spanList );
+
+	// SIMD kernel selection
+	//********************************************************************************************************************************
+
+	// The instruction sets the blitting kernels can use
+	enum SimdLevel
+	{
+		SIMD_NONE = 0,
+		SIMD_SSE2,
+		SIMD_AVX2,
+	};
+
+	// Gets the instruction set currently used by the blitting kernels
+	static SimdLevel GetSimdLevel() { return s_simdLevel; }
+	// Limits the instruction set used by the blitting kernels (useful for comparing against the scalar fallback)
+	// > Levels the CPU doesn't support are reduced to the best supported level
+	static void SetSimdLevel( SimdLevel level );
 
 private:
 
+	// Finds the best instruction set supported by the CPU
+	static SimdLevel DetectSimdLevel();
+	// Blends a row of pre-multiplied source pixels into the destination, skipping runs of fully-transparent pixels
+	static void BlendPreMultipliedRow( uint32_t* pDest, const uint32_t* pSrc, int width );
+	// Copies a row of fully opaque pre-multiplied source pixels into the destination
+	static void CopyOpaqueRow( uint32_t* pDest, const uint32_t* pSrc, int width );
+	// Blends a row of pre-multiplied source pixels into the destination using a separate multiply for each channel and a global alpha
+	static void BlendMultipliedRow( uint32_t* pDest, const uint32_t* pSrc, int width, float alphaMultiply );
+	// Adds a row of pre-multiplied source pixels multiplied by a global alpha to the destination, saturating each channel
+	static void AddMultipliedRow( uint32_t* pDest, const uint32_t* pSrc, int width, float alphaMultiply );
+	// Sets a row of destination pixels to a colour which isn't pre-multiplied, blending it if it's translucent
+	static void FillRow( uint32_t* pDest, int width, Pixel pix );
+	// Multiplies the colour channels of a row of pre-multiplied pixels by a tint (fully-transparent pixels are left unchanged)
+	static void TintRow( uint32_t* pDest, const uint32_t* pSrc, int width, Pixel tint );
+	// Checks whether a tint would change any pixel (only white doesn't)
+	static bool IsTinted( Pixel tint ) { return ( tint.bits & 0x00FFFFFF ) != 0x00FFFFFF; }
+	// Narrows [spanStart, spanEnd) to the steps i where 0 < start + i*step < limit (all in 16.16 fixed point)
+	static void ClipFixedPointSpan( long long start, int step, long long limit, int& spanStart, int& spanEnd );
+
 	PixelData* m_pRenderTarget{ nullptr };
+	// The area of the render target which can be drawn to
+	int m_clipLeft{ 0 }, m_clipTop{ 0 }, m_clipRight{ 0 }, m_clipBottom{ 0 };
+
+	// The instruction set used by the blitting kernels
+	static SimdLevel s_simdLevel;
 
 };
 
@@ -637,6 +834,7 @@ public:
 	void DrawCircle( Point2f centrePos, int radius, Pixel pix );
 	// Draws raw pixel data to the display buffer
 	// > Pre-multiplies the alpha on the image data if this hasn't been done before
+	// > With deferred drawing the pixel data must stay valid until the drawing is flushed
 	void DrawPixelData( PixelData* pixelData, Point2f pos, float alpha = 1.0f );
 
 	// Debug font functions
@@ -671,6 +869,7 @@ public:
 
 	// Gets the sprite id of the first matching sprite whose filename contains the given text
 	// > Returns -1 if not found
+	// > Each name is only searched for once, after which its id is looked up in a hash table
 	int GetSpriteId( const char* spriteName ) const;
 	// Gets the root filename of a specific sprite
 	const std::string& GetSpriteName( int spriteId );
@@ -697,19 +896,35 @@ public:
 	// Draw the sprite without rotation or transparency (fastest draw)
 	inline void Draw( int spriteId, Point2f pos, int frameIndex ) const { DrawTransparent( spriteId, pos, frameIndex, 1.0f ); }
 	// Draw the sprite with transparency (slower than without transparency)
-	void DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply ) const; // This just to force people to consider when they use an explicit alpha multiply
+	// > The tint colour is multiplied with the sprite's pixels as they are drawn, without changing the sprite
+	void DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply, Pixel tint = PIX_WHITE ) const; // This just to force people to consider when they use an explicit alpha multiply
 	// Draw the sprite rotated with transparency (slowest draw)
-	void DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale = 1.0f, float alphaMultiply = 1.0f ) const;
+	// > Falls back to DrawTransparent when the rotation and scale would move no pixel further than the rotation tolerance
+	void DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale = 1.0f, float alphaMultiply = 1.0f, Pixel tint = PIX_WHITE ) const;
+	// Sets how far (in pixels) DrawRotated can let a sprite's pixels drift before it has to use the rotate and scale path
+	// > Defaults to half a pixel, set to 0.0f to only skip exact identity transforms or a negative value to always rotate
+	void SetRotationTolerance( float pixelTolerance ) { m_rotationTolerance = pixelTolerance; }
+	// Draws many copies of the same sprite frame, each with its own position, scale and opacity (e.g. particles)
+	// > The frame is only looked up once for the whole batch, and copies with no scale or opacity aren't drawn
+	void DrawInstances( int spriteId, int frameIndex, int count, const float* pPosX, const float* pPosY, const float* pScale, const float* pAlpha, Pixel tint = PIX_WHITE, PlayBlitter::BlendMode blendMode = PlayBlitter::BLEND_NORMAL ) const;
 	// Draws a previously loaded background image
 	void DrawBackground( int backgroundIndex = 0 );
 	// Multiplies the sprite image buffer by the colour values
 	// > Applies to all subseqent drawing calls for this sprite, but can be reset by calling agin with rgb set to white
+	// > Reprocesses the whole sprite, so pass a tint to the drawing functions instead to colour individual draws
 	void ColourSprite( int spriteId, int r, int g, int b );
 
 	// Draws a string using a sprite-based font exported from PlayFontTool
-	int DrawString( int fontId, Point2f pos, std::string text ) const;
+	// > A string drawn again is composited into a single image, so from then on drawing it is a single blit
+	int DrawString( int fontId, Point2f pos, const std::string& text ) const;
 	// Draws a centred string using a sprite-based font exported from PlayFontTool
-	int DrawStringCentred( int fontId, Point2f pos, std::string text ) const;
+	int DrawStringCentred( int fontId, Point2f pos, const std::string& text ) const;
+	// Gets the width of a string drawn using a sprite-based font
+	int GetStringWidth( int fontId, const std::string& text ) const;
+	// Gets the width of a string drawn using a sprite-based font and the rectangle containing its visible pixels, relative
+	//   to the position it's drawn at (right and bottom are exclusive, and the rectangle is empty if nothing is visible)
+	// > Only the font's glyph metrics are used, so none of its pixels are read
+	int MeasureText( int fontId, const std::string& text, int& left, int& top, int& right, int& bottom ) const;
 	// Draws an individual text character using a sprite-based font 
 	int DrawChar( int fontId, Point2f pos, char c ) const;
 	// Draws a rotated text character using a sprite-based font 
@@ -720,6 +935,23 @@ public:
 	// A pixel-based sprite collision test based on drawing
 	bool SpriteCollide( int s1Id, Point2f s1Pos, int s1FrameIndex, float s1Angle, int s1PixelColl[4], int s2Id, Point2f s2pos, int s2FrameIndex, float s2Angle, int s2PixelColl[4] ) const;
 
+	// Internal structure for the visible (not fully-transparent) part of a single sprite frame
+	struct SpriteFrame
+	{
+		int trimX{ 0 }, trimY{ 0 }; // The offset of the trimmed rectangle from the top left of the frame
+		int trimWidth{ 0 }, trimHeight{ 0 }; // The size of the trimmed rectangle (zero for a completely transparent frame)
+		SpanList spans; // The runs of visible pixels in each row of the trimmed rectangle
+		int maskStride{ 0 }; // The number of 64-bit words in each row of the collision mask, including a padding word
+		std::vector<uint64_t> collisionMask; // One bit for each pixel in the trimmed rectangle, set where the pixel has any alpha
+	};
+
+	// The layout of a single sprite frame when it's drawn as a character of a font
+	struct GlyphMetrics
+	{
+		uint8_t advance{ 0 }; // The distance to the next character (hidden in the canvas pixel data by PlayFontTool)
+		int16_t left{ 0 }, top{ 0 }, right{ 0 }, bottom{ 0 }; // The visible rectangle within the frame (empty if there isn't one)
+	};
+
 	// Internal sprite structure for storing individual sprite data
 	struct Sprite
 	{
@@ -731,14 +963,48 @@ public:
 		int originX{ 0 }, originY{ 0 }; // The origin and centre of rotation for the sprite (whole pixels only)
 		PixelData canvasBuffer; // The sprite image data
 		PixelData preMultAlpha; // The sprite data pre-multiplied with its own alpha
+		std::vector<SpriteFrame> frames; // The visible area of each frame
+		std::vector<GlyphMetrics> glyphs; // The metrics of each frame as a font character (kept apart from frames so they pack closely)
 		Sprite() = default;
 	};
 
+	// Deferred drawing functions
+	//********************************************************************************************************************************
+
+	// Switches deferred drawing on or off
+	// > Deferred drawing into the display buffer is recorded and binned into screen tiles instead of being drawn straight away.
+	//   The tiles are rasterized in parallel by a pool of worker threads when the drawing is flushed.
+	// > workerThreads = -1 uses one fewer worker than there are hardware threads (the flushing thread also rasterizes tiles)
+	void SetDeferredDrawing( bool deferred, int workerThreads = -1 );
+	// Returns whether drawing into the display buffer is being deferred
+	bool GetDeferredDrawing() const { return m_bDeferred; }
+	// Rasterizes any drawing recorded in deferred mode into the display buffer
+	// > Waits for the render thread to finish the previous frame first when drawing is pipelined
+	void FlushDrawing();
+	// Switches pipelined drawing on or off (switching deferred drawing on as well)
+	// > Each frame's recorded drawing is rasterized and presented on a render thread while the game updates the next frame.
+	//   The recorded drawing commands hold copies of everything they draw, so they act as a snapshot of the frame.
+	void SetPipelinedDrawing( bool pipelined );
+	// Returns whether deferred drawing is being pipelined
+	bool GetPipelinedDrawing() const { return m_renderThread.joinable(); }
+	// Sets the layer for the deferred drawing which follows: higher layers are drawn over lower ones whatever order the
+	//   drawing is done in, and drawing goes back to layer 0 each time a frame is presented
+	// > sortBySprite lets sprites drawn in the layer be reordered so each sprite frame is drawn together, which keeps its
+	//   pixels in the cache. Only use it when the order sprites in the layer overlap each other doesn't matter.
+	// > Drawing which isn't deferred is always done straight away, so it ignores layers
+	void SetDrawingLayer( int layer, bool sortBySprite = false );
+	// Finishes the frame's drawing and then calls the present function with the range of rows which have changed since the
+	//   last present (bottom is exclusive, and top == bottom if nothing has changed)
+	// > With pipelined drawing the frame is handed to the render thread and this returns without waiting for it to be drawn.
+	//   It does wait for the previous frame, so the game never gets more than one frame ahead of the display.
+	void PresentFrame( std::function<void( int top, int bottom )> present );
+
 	// Miscellaneous functions
 	//********************************************************************************************************************************
 
-	// Gets a pointer to the drawing buffer's pixel data
-	PixelData* GetDrawingBuffer( void ) { return &m_playBuffer; }
+	// Gets a pointer to the drawing buffer's pixel data (flushing any deferred drawing first)
+	// > The whole buffer is treated as changed, as the pixels could be written to directly
+	PixelData* GetDrawingBuffer( void ) { FlushDrawing(); InvalidateTiles(); return &m_playBuffer; }
 	// Resets the timing bar data and sets the current timing bar segment to a specific colour
 	void TimingBarBegin( Pixel pix );
 	// Sets the current timing bar segment to a specific colour
@@ -749,9 +1015,10 @@ public:
 	// Gets the duration (in milliseconds) of a specific timing segment
 	float GetTimingSegmentDuration( int id ) const;
 	// Clears the display buffer using the given pixel colour
-	void ClearBuffer( Pixel colour ) { m_blitter.ClearRenderTarget( colour ); }
-	// Sets the render target for drawing operations
-	PixelData* SetRenderTarget( PixelData* renderTarget ) { return m_blitter.SetRenderTarget( renderTarget ); }
+	void ClearBuffer( Pixel colour );
+	// Sets the render target for drawing operations (flushing any deferred drawing first)
+	// > Drawing is only deferred while the display buffer is the render target
+	PixelData* SetRenderTarget( PixelData* renderTarget ) { FlushDrawing(); return m_blitter.SetRenderTarget( renderTarget ); }
 
 
 
@@ -775,20 +1042,56 @@ private:
 	// Multiplies the sprite image by its own alpha transparency values to save repeating this calculation on every draw
 	// > A colour multiplication can also be applied at this stage, which affects all subseqent drawing operations on the sprite
 	void PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int height, int maxSkipWidth, float alphaMultiply, Pixel colourMultiply );
+	// Works out the trimmed rectangle, span list, collision mask and glyph metrics for each frame of a sprite
+	// > Any sprite can be drawn as a font, so every sprite gets glyph metrics
+	void CreateSpriteFrames( Sprite& s );
+	// Reads the 64 bits of a collision mask row starting at the given bit
+	static uint64_t ReadMaskBits( const uint64_t* pMaskRow, int bit );
 
 	// Count of the total number of sprites loaded
 	int m_nTotalSprites{ 0 };
 	// Whether the singleton has been initialised yet
 	bool m_bInitialised{ false };
 
+	// A string drawn with a sprite-based font, composited into a single pre-multiplied image with its own span list
+	struct CachedText
+	{
+		int fontId{ -1 };
+		std::string text;
+		int width{ 0 }; // The total width of the characters
+		int imageX{ 0 }, imageY{ 0 }; // The position of the image's top left pixel relative to the first character's frame
+		std::vector<Pixel> pixels; // The image pixels (empty until composited, or if the characters have to be drawn one at a time)
+		PixelData image;
+		SpanList spans;
+		size_t bytes{ 0 }; // The memory used by the image and span list
+		bool composited{ false }; // Whether CompositeText has run (it's retried a frame later if the cache was too full)
+		int lastCompositeFrame{ -1 };
+		int lastUsedFrame{ 0 };
+	};
+
+	// Gets the cached image of a string, compositing it the second time the string is drawn
+	// > The first time a string is drawn it's only remembered, so strings which are only drawn once aren't composited
+	// > Returns nullptr in the unlikely event that the string's hash matches another cached string
+	const CachedText* GetCachedText( int fontId, const std::string& text ) const;
+	// Composites the characters of a string into its cached image, returning false if there wasn't room in the cache
+	bool CompositeText( CachedText& cached ) const;
+	// Frees the least recently drawn images until the given number of bytes fits in the cache, returning false if it can't
+	// > Only images which the frames still being drawn can't be using are freed
+	bool MakeRoomForCachedText( size_t bytes ) const;
+	// Forgets a cached string and returns the next one
+	std::unordered_map< uint64_t, CachedText >::iterator EraseCachedText( std::unordered_map< uint64_t, CachedText >::iterator it ) const;
+	// Forgets cached strings which haven't been drawn for a while
+	void ExpireCachedText();
+	// Forgets every cached string drawn with the given font (which must not be used by any deferred drawing)
+	void ClearCachedText( int fontId );
+
 	// Allocates a buffer for the debug font and copies the font pixel data to it
 	void DecompressDubugFont( void );
 	// Returns the pixel width of a string using the debug font
 	int GetDebugStringWidth( const std::string& s );
-	// Draws the offset points from the origin in all octants
-	void DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix );
 	// Ends the current timing segment and calculates the duration
-	LARGE_INTEGER EndTimingSegment();
+	// > Returns the current time in nanoseconds
+	long long EndTimingSegment();
 
 	struct TimingSegment
 	{
@@ -802,15 +1105,138 @@ private:
 	std::vector<TimingSegment> m_vTimings;
 	std::vector<TimingSegment> m_vPrevTimings;
 
+	// Internal functions relating to deferred drawing
+	//********************************************************************************************************************************
+
+	// A single drawing operation which can be performed straight away or recorded for later
+	struct DrawCommand
+	{
+		enum Type
+		{
+			DRAW_PIXEL = 0,
+			DRAW_LINE,
+			DRAW_BLIT,
+			DRAW_BLIT_SPANS,
+			DRAW_ROTATE,
+			DRAW_CLEAR,
+			DRAW_BACKGROUND,
+			DRAW_RECT,
+			DRAW_CIRCLE,
+		};
+
+		Type type{ DRAW_PIXEL };
+		int x{ 0 }, y{ 0 }; // The position in the display buffer (or the start of a line)
+		int width{ 0 }, height{ 0 }; // The size of the source image or rectangle (or the end of a line, or a circle's radius)
+		int originX{ 0 }, originY{ 0 }; // The centre of rotation within the source image
+		float angle{ 0.0f }, scale{ 1.0f }, alphaMultiply{ 1.0f };
+		Pixel pix; // The colour of pixels, lines and clears
+		PixelData source; // The source image (only the pointer is copied, not the pixels)
+		int sourceOffset{ 0 }; // The offset of the source image's top left pixel within the source pixel data
+		const SpanList* pSpans{ nullptr }; // The spans for DRAW_BLIT_SPANS
+		Pixel tint{ PIX_WHITE }; // The colour DRAW_BLIT_SPANS and DRAW_ROTATE multiply the source pixels by
+		PlayBlitter::BlendMode blendMode{ PlayBlitter::BLEND_NORMAL }; // How DRAW_BLIT_SPANS and DRAW_ROTATE combine pixels with the target
+		int spriteFrame{ -1 }; // Identifies the sprite and frame being drawn, for sorting by sprite (-1 for other drawing)
+		uint64_t sortKey{ 0 }; // The layer, sprite frame and submission order packed into the order deferred drawing is done in
+	};
+
+	// Performs a drawing command straight away, or records it if drawing into the display buffer is deferred
+	void Submit( const DrawCommand& command ) const;
+	// Performs a drawing command using the given blitter
+	static void ExecuteDrawCommand( const PlayBlitter& blitter, const DrawCommand& command );
+	// Works out the rectangle of pixels a drawing command could change (right and bottom are exclusive)
+	static void GetDrawCommandBounds( const DrawCommand& command, int& left, int& top, int& right, int& bottom );
+	// Identifies what a drawing command which covers every pixel leaves in a tile, or returns 0 if it doesn't cover every pixel
+	static uint64_t GetCoverKey( const DrawCommand& command );
+	// Rasterizes the binned drawing commands tile by tile until there are no tiles left
+	// > Anything in a tile's bin before the last command which covers the whole tile is skipped, as is the whole bin when
+	//   the tile already holds what that command would leave in it
+	void RasterizeTiles();
+	// The main loop of each rasterizing worker thread
+	void RasterizeWorker( int workGeneration );
+	// Stops and joins all of the rasterizing worker threads
+	void StopWorkers();
+	// Rasterizes the drawing commands swapped in for rasterizing using all of the workers, then clears them
+	void RasterizeFrame();
+	// The main loop of the pipelined render thread
+	void RenderThread();
+	// Waits until the render thread has finished any frame it is drawing
+	void WaitForRenderThread();
+	// Stops and joins the render thread
+	void StopRenderThread();
+	// Forgets what the screen tiles hold and marks them all as changed
+	void InvalidateTiles();
+	// Gets the range of rows containing tiles which have changed since the last call, and marks them as unchanged
+	void GetChangedRows( int& top, int& bottom );
+
 	// The PlayBlitter used for drawing
 	PlayBlitter m_blitter;
 
+	// The width and height of the screen tiles used by deferred drawing
+	static constexpr int TILE_SIZE = 64;
+	// Whether drawing into the display buffer is being deferred
+	bool m_bDeferred{ false };
+	// The drawing commands recorded since the last flush
+	mutable std::vector<DrawCommand> m_vDrawCommands;
+	// The layer for deferred drawing and whether sprites drawn in it can be sorted
+	int m_drawingLayer{ 0 };
+	bool m_bSortLayer{ false };
+	// Set when the recorded or rasterizing commands can't simply be drawn in submission order
+	mutable bool m_bReordered{ false };
+	bool m_bRasterReordered{ false };
+	// The indices of the drawing commands touching each screen tile, in the order they were submitted
+	mutable std::vector<std::vector<int>> m_vTileBins;
+	// The drawing commands and tile bins being rasterized, which are swapped with the recorded ones
+	std::vector<DrawCommand> m_vRasterCommands;
+	std::vector<std::vector<int>> m_vRasterBins;
+	// The number of screen tiles across the display buffer
+	int m_tileColumns{ 0 };
+	// What each screen tile holds when the last thing drawn in it covered the whole tile (0 if it isn't known)
+	// > Tiles which hold just the background need not be drawn again until something is drawn over them
+	std::vector<uint64_t> m_vTileContents;
+	// Whether each screen tile has changed since the display buffer was last presented
+	std::vector<uint8_t> m_vTileChanged;
+
+	// The rasterizing worker threads and the state they share
+	std::vector<std::thread> m_vWorkers;
+	std::mutex m_workMutex;
+	std::condition_variable m_workStart;
+	std::condition_variable m_workDone;
+	int m_workGeneration{ 0 };
+	int m_workersBusy{ 0 };
+	bool m_bStopWorkers{ false };
+	std::atomic<int> m_nextTile{ 0 };
+
+	// The pipelined render thread and the frame handed over to it
+	std::thread m_renderThread;
+	std::mutex m_renderMutex;
+	std::condition_variable m_renderStart;
+	std::condition_variable m_renderDone;
+	std::function<void( int, int )> m_renderPresent;
+	bool m_bFramePending{ false };
+	bool m_bStopRenderThread{ false };
+	// The largest pixel movement a DrawRotated transform can cause and still be drawn without rotation
+	float m_rotationTolerance{ 0.5f };
+
 	// Buffer pointers
 	PixelData m_playBuffer;
 	uint8_t* m_pDebugFontBuffer{ nullptr };
 
 	// A vector of all the loaded sprites
 	std::vector< Sprite > vSpriteData;
+	// The id found for each (uppercase) name GetSpriteId has been asked for, including -1 for names which weren't found
+	mutable std::unordered_map< std::string, int > m_spriteIdLookup;
+	// The strings drawn recently, keyed by a hash of their font and text
+	mutable std::unordered_map< uint64_t, CachedText > m_textCache;
+	// The memory used by the cached string images
+	mutable size_t m_textCacheBytes{ 0 };
+	// The number of frames presented, used to expire cached strings
+	int m_textFrame{ 0 };
+	// The number of frames a cached string is kept for without being drawn (always more than the frames in flight)
+	static constexpr int TEXT_CACHE_FRAMES = 60;
+	// The number of frames which can still be drawing a cached string after it was last drawn
+	static constexpr int TEXT_FRAMES_IN_FLIGHT = 2;
+	// The most memory the cached string images can use before older ones are freed
+	static constexpr size_t TEXT_CACHE_BYTES = 2 * 1024 * 1024;
 	// A vector of all the loaded backgrounds
 	std::vector< PixelData > vBackgroundData;
 
@@ -819,6 +1245,89 @@ private:
 
 };
 
+#endif
+#ifndef PLAY_PLAYPARTICLES_H
+#define PLAY_PLAYPARTICLES_H
+//********************************************************************************************************************************
+// File:		PlayParticles.h
+// Description:	Simulates and draws large numbers of short-lived sprites without using GameObjects
+// Platform:	Independent
+// Notes:		Each emitter keeps its particles in a fixed-capacity ring buffer with a separate array for each property
+//********************************************************************************************************************************
+
+// The way a particle property changes over the particle's lifetime
+struct ParticleCurve
+{
+	float start{ 1.0f }; // The value when the particle is emitted
+	float end{ 1.0f }; // The value when the particle expires
+	float power{ 1.0f }; // 1 changes the value linearly, higher values change it slowly at first and lower values quickly at first
+
+	// Gets the value a fraction (0-1) of the way through the particle's lifetime
+	float Evaluate( float t ) const { return start + ( end - start ) * ( power == 1.0f ? t : powf( t, power ) ); }
+};
+
+// Describes the particles created by an emitter and how they are drawn
+struct ParticleSettings
+{
+	int spriteId{ -1 }; // The sprite drawn for every particle
+	int frameIndex{ 0 }; // The frame of the sprite drawn for every particle
+	float lifetime{ 1.0f }; // The number of seconds each particle lasts (the same for every particle, so the oldest always expire first)
+	ParticleCurve scale{ 1.0f, 1.0f }; // The scale of each particle over its lifetime
+	ParticleCurve alpha{ 1.0f, 0.0f }; // The opacity of each particle over its lifetime
+	Vector2f spread{ 0.0f, 0.0f }; // Particles are emitted up to this far either side of the emitter position
+	Vector2f velocity{ 0.0f, 0.0f }; // The velocity of new particles in pixels per second
+	float burstSpeed{ 0.0f }; // Each new particle gets a random extra velocity of up to this many pixels per second, in any direction
+	Vector2f acceleration{ 0.0f, 0.0f }; // Added to each particle's velocity every second (e.g. gravity)
+	Pixel tint{ PIX_WHITE }; // The colour the sprite is multiplied by
+	PlayBlitter::BlendMode blendMode{ PlayBlitter::BLEND_NORMAL }; // BLEND_ADDITIVE suits glowing effects like sparks and fire
+};
+
+// Creates, moves and draws a fixed maximum number of particles which all share the same settings
+// > The particles are stored as a structure of arrays so updating them is a tight loop over each property
+class ParticleEmitter
+{
+public:
+	// Creates an emitter which can hold up to capacity particles at once
+	ParticleEmitter( const ParticleSettings& settings, int capacity );
+
+	// Creates particles around the given position
+	// > The oldest particles are replaced when the emitter is full
+	void Emit( Point2f pos, int count = 1 );
+	// Moves and ages the particles, removing any which have expired
+	void Update( float elapsedTime );
+	// Draws all of the particles as a single batch, oldest first
+	void Draw() const;
+	// Removes all of the particles
+	void Clear() { m_first = 0; m_count = 0; }
+
+	// Gets the number of live particles
+	int GetCount() const { return m_count; }
+	// Gets the maximum number of particles the emitter can hold
+	int GetCapacity() const { return m_capacity; }
+	// Gets the settings used by the emitter, which can be changed at any time
+	ParticleSettings& GetSettings() { return m_settings; }
+
+private:
+	// Calls the function for each contiguous range of live particles in the ring buffer (there are at most two)
+	template< typename Function > void ForEachRange( Function function ) const
+	{
+		int firstEnd = std::min( m_first + m_count, m_capacity );
+		if( m_first < firstEnd )
+			function( m_first, firstEnd );
+		if( m_first + m_count > m_capacity )
+			function( 0, m_first + m_count - m_capacity );
+	}
+
+	ParticleSettings m_settings;
+	int m_capacity{ 0 };
+	// The index of the oldest particle and the number of live particles
+	int m_first{ 0 }, m_count{ 0 };
+	// The properties of each particle, indexed by its position in the ring buffer
+	std::vector<float> m_posX, m_posY, m_velX, m_velY, m_age;
+	// The live particles' positions, scales and opacities, gathered in order for drawing
+	mutable std::vector<float> m_drawX, m_drawY, m_drawScale, m_drawAlpha;
+};
+
 #endif
 #ifndef PLAY_PLAYAUDIO_H
 #define PLAY_PLAYAUDIO_H
@@ -956,14 +1465,14 @@ private:
 #define PLAY_ADD_GAMEOBJECT_MEMBERS 
 #endif
 
-// PlayManager manges a map of GameObject structures
+// PlayManager manges a slot map of GameObject structures
 // > Additional member variables can be added with PLAY_ADD_GAMEOBJECT_MEMBERS 
 struct GameObject
 {
-	GameObject( int type, Point2D pos, int collisionRadius, int spriteId );
+	GameObject( int type, Point2D pos, int collisionRadius, int spriteId, int id = -1 );
 
 	// Default member variables: don't change these!
-	int type{ -1 };
+	int type{ -1 }; // Use Play::SetGameObjectType() to change this so the manager can track it
 	int spriteId{ -1 };
 	Point2D pos{ 0.0f, 0.0f };
 	Point2D oldPos{ 0.0f, 0.0f };
@@ -1009,6 +1518,21 @@ namespace Play
 		ALL,
 	};
 
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+	// A range of GameObject ids which can be used with a range-based for loop
+	struct GameObjectIdView
+	{
+		const int* first{ nullptr };
+		const int* last{ nullptr };
+
+		const int* begin() const { return first; }
+		const int* end() const { return last; }
+		size_t size() const { return static_cast<size_t>( last - first ); }
+		bool empty() const { return first == last; }
+		int operator[]( size_t index ) const { return first[index]; }
+	};
+#endif
+
 	// PlayManager uses colour values from 0-100 for red, green, blue and alpha
 	struct Colour
 	{
@@ -1023,7 +1547,8 @@ namespace Play
 	//**************************************************************************************************
 
 	// Initialises the managers and creates a window of the required dimensions
-	void CreateManager( int width, int height, int scale );
+	// > reserveGameObjects preallocates storage for that many GameObjects when using the GameObject manager
+	void CreateManager( int width, int height, int scale, int reserveGameObjects = 0 );
 	// Shuts down the managers and closes the window
 	void DestroyManager();
 
@@ -1040,6 +1565,8 @@ namespace Play
 	int GetBufferWidth();
 	// Gets the height of the display buffer
 	int GetBufferHeight();
+	// Sets the frame rate the game loop is paced to (60 by default), or 0 to run uncapped for benchmarking
+	void SetFrameRate( int framesPerSecond );
 
 	// PlayAudio functions
 	//**************************************************************************************************
@@ -1062,6 +1589,15 @@ namespace Play
 	void DrawBackground( int background = 0 );
 	// Draws text to the screen using the built-in debug font
 	void DrawDebugText( Point2D pos, const char* text, Colour col = cWhite, bool centred = true );
+	// Records drawing and rasterizes it on multiple threads when the drawing buffer is presented (off by default)
+	void SetDeferredDrawing( bool deferred );
+	// Rasterizes and presents each frame on a render thread while the game updates the next one (off by default)
+	// > Switches on deferred drawing as well
+	void SetPipelinedDrawing( bool pipelined );
+	// Sets the layer for the drawing which follows: higher layers are drawn on top, and each frame starts in layer 0
+	// > sortBySprite allows sprites in the layer to be reordered to draw each sprite frame together (faster)
+	// > Layers only work with deferred drawing
+	void SetDrawingLayer( int layer, bool sortBySprite = false );
 
 	// Gets the sprite id of the first matching sprite whose filename contains the given text
 	int GetSpriteId( const char* spriteName );
@@ -1114,20 +1650,28 @@ namespace Play
 	void DrawSpriteRotated( const char* spriteName, Point2D pos, int frame, float angle, float scale = 1.0f, float opacity = 1.0f );
 	// Draws the sprite with rotation and transparency (slowest DrawSprite)
 	void DrawSpriteRotated( int spriteID, Point2D pos, int frame, float angle, float scale, float opacity = 1.0f );
+	// Draws the sprite multiplied by a colour, without affecting any other drawing of the sprite (unlike ColourSprite)
+	void DrawSpriteTinted( const char* spriteName, Point2D pos, int frame, Colour tint, float opacity = 1.0f );
+	// Draws the sprite multiplied by a colour, without affecting any other drawing of the sprite (unlike ColourSprite)
+	void DrawSpriteTinted( int spriteID, Point2D pos, int frame, Colour tint, float opacity = 1.0f );
 	// Draws a single-pixel wide line between two points in the given colour
 	void DrawLine( Point2D start, Point2D end, Colour col );
 	// Draws a single-pixel wide circle in the given colour
 	void DrawCircle( Point2D pos, int radius, Colour col );
 	// Draws a rectangle in the given colour
 	void DrawRect( Point2D topLeft, Point2D bottomRight, Colour col, bool fill = false );
-	// Draws a line between two points using a sprite
-	// > Note that colouring affects subsequent DrawSprite calls using the same sprite!!
+	// Draws a line between two points using a sprite tinted with the given colour
 	void DrawSpriteLine( Point2D startPos, Point2D endPos, const char* penSprite, Colour c = cWhite );
-	// Draws a circle using a sprite
-	// > Note that colouring affects subsequent DrawSprite calls using the same sprite!!
+	// Draws a circle using a sprite tinted with the given colour
 	void DrawSpriteCircle( int x, int y, int radius, const char* penSprite, Colour c = cWhite );
 	// Draws text using a sprite-based font exported from PlayFontTool
-	void DrawFontText( const char* fontId, std::string text, Point2D pos, Align justify = LEFT );
+	void DrawFontText( const char* fontId, const std::string& text, Point2D pos, Align justify = LEFT );
+	// Draws text using a sprite-based font with a specific ID
+	void DrawFontText( int fontId, const std::string& text, Point2D pos, Align justify = LEFT );
+	// Gets the width of text drawn using a sprite-based font exported from PlayFontTool
+	int MeasureText( const char* fontId, const std::string& text );
+	// Gets the width of text drawn using a sprite-based font with a specific ID
+	int MeasureText( int fontId, const std::string& text );
 	// Adds a sprite dynamically from memory (custom asset pipelines)
 
 	// Resets the timing bar data and sets the current timing bar segment to a specific colour
@@ -1138,6 +1682,24 @@ namespace Play
 	// Draws the timing bar for the previous frame at the given position and size
 	void DrawTimingBar( Point2f pos, Point2f size );
 
+	// Particle functions
+	//**************************************************************************************************
+
+	// Creates a particle emitter which draws the first matching sprite whose filename contains the given text
+	// > Returns the emitter's id. It holds up to capacity particles at once, replacing the oldest when it's full.
+	int CreateParticleEmitter( const char* spriteName, int capacity, const ParticleSettings& settings );
+	// Gets the settings of an emitter so they can be changed
+	// > The reference stays valid when more emitters are created, until the manager is destroyed
+	ParticleSettings& GetParticleSettings( int emitterId );
+	// Creates particles from an emitter around the given position
+	void EmitParticles( int emitterId, Point2D pos, int count = 1 );
+	// Moves and ages the particles of every emitter, removing any which have expired
+	void UpdateParticles( float elapsedTime );
+	// Draws all of an emitter's particles in a single batch
+	void DrawParticles( int emitterId );
+	// Removes all of an emitter's particles, or the particles of every emitter if emitterId is -1
+	void ClearParticles( int emitterId = -1 );
+
 	// GameObject functions
 	//**************************************************************************************************
 
@@ -1149,13 +1711,21 @@ namespace Play
 	// Retrieves a GameObject based on its id
 	// > Returns an object with a type of -1 if no object can be found
 	GameObject& GetGameObject( int id );
-	// Retrieves the first GameObject matching the given type
+	// Retrieves the first GameObject matching the given type (the one which has had the type longest)
 	// > Returns an object with a type of -1 if no object can be found
 	GameObject& GetGameObjectByType( int type );
-	// Collects the IDs of all of the GameObjects with the matching type
+	// Collects the IDs of all of the GameObjects with the matching type, in the order they were created or given the type
 	std::vector<int> CollectGameObjectIDsByType( int type );
-	// Collects the IDs of all of the GameObjects
+	// Gets a view of the IDs of all of the GameObjects with the matching type without allocating a copy (in the same order)
+	// > The view is only valid until GameObjects are created, destroyed or have their type changed, so use
+	//   CollectGameObjectIDsByType() instead when doing any of those while looping over the IDs
+	GameObjectIdView GetGameObjectIDsByType( int type );
+	// Collects the IDs of all of the GameObjects, in the order they were created
 	std::vector<int> CollectAllGameObjectIDs();
+	// Changes the type of the object, keeping the manager's lookups by type up to date
+	// > Always use this instead of assigning to GameObject.type directly
+	// > The object goes to the end of the list of objects with the new type, as if it had just been created
+	void SetGameObjectType( GameObject& obj, int newType );
 	// Performs a typical update of the object's position and animation
 	void UpdateGameObject( GameObject& object );
 	// Deletes the GameObject with the corresponding id
@@ -1166,6 +1736,19 @@ namespace Play
 	
 	// Checks whether the two objects are within each other's collision radii
 	bool IsColliding( GameObject& obj1, GameObject& obj2 );
+	// Gets the IDs of all of the other GameObjects colliding with the object whose types are in the type mask
+	// > The mask has a bit set for each type to include, e.g. ( 1 << TYPE_ROCK ) | ( 1 << TYPE_GEM ), so only types 0-31 can be used
+	// > Uses a spatial grid which objects are moved around in as they're updated, so if you set an object's position directly
+	//   either do it before calling UpdateGameObject() on it or call MarkGameObjectMoved() after (new objects can be moved
+	//   freely until the next query, and debug builds assert if a nearby object has moved without either)
+	// > The view is only valid until the next call to QueryCollisions()
+	GameObjectIdView QueryCollisions( GameObject& obj, unsigned int typeMask = 0xFFFFFFFF );
+	// Tells the manager that the object's position or collision radius has been changed directly, so collision queries use the new values
+	void MarkGameObjectMoved( GameObject& obj );
+	// Calls the function for every colliding pair of GameObjects where the first has typeA and the second has typeB
+	// > Each pair is only visited once when typeA and typeB are the same
+	// > The pairs are found before any calls are made, so the function can destroy objects or change their types
+	void ForEachCollidingPair( int typeA, int typeB, const std::function<void( GameObject&, GameObject& )>& callback );
 	// Checks whether any part of the object is visible within the DisplayBuffer
 	bool IsVisible( GameObject& obj );
 	// Checks whether the object is overlapping the edge of the screen and moving outwards 
@@ -1180,6 +1763,8 @@ namespace Play
 
 	// Changes the object's current spite and resets its animation frame to the start
 	void SetSprite( GameObject& obj, const char* spriteName, float animSpeed );
+	// Changes the object's current spite to the one with a specific ID and resets its animation frame to the start
+	void SetSprite( GameObject& obj, int spriteId, float animSpeed );
 	// Draws the object's sprite without rotation or transparency (fastest)
 	void DrawObject( GameObject& obj );
 	// Draws the object's sprite with transparency (slower than DrawObject)
@@ -1187,6 +1772,16 @@ namespace Play
 	// Draws the object's sprite with rotation and transparency (slower than DrawObject)
 	void DrawObjectRotated( GameObject& obj, float opacity = 1.0f );
 
+	// Sets the length of each fixed simulation step in seconds (1/FRAMES_PER_SECOND by default)
+	void SetFixedTimeStep( float timeStep );
+	// Adds the time since the last frame to the accumulator and returns how many fixed steps to simulate to catch up
+	// > Once fixed steps are in use the DrawObject functions interpolate between each object's oldPos/oldRot and
+	//   pos/rotation, so objects move smoothly however the frame rate compares to the step rate
+	// > Objects which haven't been updated since they were created are drawn where they are
+	int AccumulateFixedSteps( float elapsedTime );
+	// Gets how far the current frame is between the previous fixed step and the latest one (0-1)
+	float GetFixedStepAlpha();
+
 #endif
 
 	// Miscellaneous functions
@@ -1270,7 +1865,7 @@ struct ALLOC
 	size_t size = 0;
 	int id = 0;
 
-	ALLOC( void* a, const char* fn, int l, size_t s ) { address = a; line = l; size = s; id = g_allocId++; strcpy_s( file, fn ); };
+	ALLOC( void* a, const char* fn, int l, size_t s ) { address = a; line = l; size = s; id = g_allocId++; snprintf( file, sizeof( file ), "%s", fn ); };
 	ALLOC( void ) {};
 };
 
@@ -1424,11 +2019,11 @@ void PrintAllocation( const char* tagText, ALLOC& a )
 		char* lastSlash = strrchr( a.file, '\\' );
 		if( lastSlash )
 		{
-			strcpy_s( buffer, lastSlash + 1 );
-			strcpy_s( a.file, buffer );
+			snprintf( buffer, sizeof( buffer ), "%s", lastSlash + 1 );
+			snprintf( a.file, sizeof( a.file ), "%s", buffer );
 		}
 		// Format in such a way that VS can double click to jump to the allocation.
-		sprintf_s( buffer, "%s %s(%d): 0x%02X %d bytes [%d]\n", tagText, a.file, a.line, static_cast<int>( reinterpret_cast<long long>( a.address ) ), static_cast<int>( a.size ), a.id );
+		snprintf( buffer, sizeof( buffer ), "%s %s(%d): 0x%02X %d bytes [%d]\n", tagText, a.file, a.line, static_cast<int>( reinterpret_cast<long long>( a.address ) ), static_cast<int>( a.size ), a.id );
 		DebugOutput( buffer );
 	}
 }
@@ -1446,7 +2041,7 @@ void PrintAllocations( const char* tagText )
 		PrintAllocation( tagText, a );
 		bytes += a.size;
 	}
-	sprintf_s( buffer, "%s Total = %d bytes\n", tagText, bytes );
+	snprintf( buffer, sizeof( buffer ), "%s Total = %d bytes\n", tagText, bytes );
 	DebugOutput( buffer );
 	DebugOutput( "**************************************************\n" );
 
@@ -1463,9 +2058,11 @@ void PrintAllocations( const char* tagText )
 // Notes:		Uses a 32-bit ARGB display buffer
 //********************************************************************************************************************************
 
+#ifndef PLAY_HEADLESS
 // Instruct Visual Studio to add these to the list of libraries to link
 #pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "dwmapi.lib")
+#endif
 
 PlayWindow* PlayWindow::s_pInstance = nullptr;
 
@@ -1474,6 +2071,7 @@ extern void MainGameEntry( int argc, char* argv[] );
 extern bool MainGameUpdate( float ); // Called every frame
 extern int MainGameExit( void ); // Called on quit
 
+#ifndef PLAY_HEADLESS
 ULONG_PTR g_pGDIToken = 0;
 
 int WINAPI WinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd )
@@ -1489,6 +2087,26 @@ int WINAPI WinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
 	return PlayWindow::Instance().HandleWindows( hInstance, hPrevInstance, lpCmdLine, nShowCmd, L"PlayBuffer" );
 }
+#else
+// Headless builds are ordinary console programs
+// > "--frames <n>" quits after n frames and "--input <file>" loads a script of keyboard and mouse input (see LoadInputScript)
+int main( int argc, char* argv[] )
+{
+	MainGameEntry( argc, argv );
+
+	PlayWindow& window = PlayWindow::Instance();
+
+	for( int i = 1; i < argc - 1; i++ )
+	{
+		if( strcmp( argv[i], "--frames" ) == 0 )
+			window.SetFrameLimit( atoi( argv[++i] ) );
+		else if( strcmp( argv[i], "--input" ) == 0 )
+			PLAY_ASSERT_MSG( window.LoadInputScript( argv[++i] ), "Unable to open the input script" );
+	}
+
+	return window.HandleHeadless();
+}
+#endif
 
 //********************************************************************************************************************************
 // Constructor / Destructor (Private)
@@ -1533,10 +2151,42 @@ void PlayWindow::Destroy()
 	s_pInstance = nullptr;
 }
 
+#ifndef PLAY_HEADLESS
 //********************************************************************************************************************************
 // Windows functions
 //********************************************************************************************************************************
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002 // Missing from SDKs before Windows 10 1803
+#endif
+
+// Waits until the performance counter reaches the target time
+// > Sleeps on the timer until spinTime milliseconds before the target, then spins because timer wake ups can be late
+static void WaitForFrameTime( HANDLE hTimer, LONGLONG targetTime, LONGLONG frequency, double spinTime )
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter( &now );
+
+	LONGLONG sleepTicks = targetTime - now.QuadPart - static_cast<LONGLONG>( spinTime * frequency / 1000.0 );
+
+	if( hTimer && sleepTicks > 0 )
+	{
+		// Negative due times are relative, in 100 nanosecond units
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -( sleepTicks * 10000000 / frequency );
+
+		if( dueTime.QuadPart < 0 && SetWaitableTimer( hTimer, &dueTime, 0, nullptr, nullptr, FALSE ) )
+			WaitForSingleObject( hTimer, INFINITE );
+	}
+
+	do
+	{
+		YieldProcessor();
+		QueryPerformanceCounter( &now );
+
+	} while( now.QuadPart < targetTime );
+}
+
 int PlayWindow::HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow, LPCWSTR windowName )
 {
 	UNREFERENCED_PARAMETER( hPrevInstance );
@@ -1590,14 +2240,30 @@ int PlayWindow::HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPS
 	QueryPerformanceCounter( &lastDrawTime );
 	QueryPerformanceFrequency( &frequency );
 
+	// Sleep on a high resolution timer between frames (Windows 10 1803 onwards) rather than spinning the whole time
+	// > Older versions fall back to a normal timer with the system timer resolution raised to 1ms, and spin for longer
+	HANDLE hFrameTimer = CreateWaitableTimerExW( nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS );
+	double spinTime = 0.5;
+	bool raisedTimerResolution = false;
+
+	if( !hFrameTimer )
+	{
+		hFrameTimer = CreateWaitableTimerExW( nullptr, nullptr, 0, TIMER_ALL_ACCESS );
+		raisedTimerResolution = timeBeginPeriod( 1 ) == TIMERR_NOERROR;
+		spinTime = 2.0;
+	}
+
 	// Standard windows message loop
 	while( !quit )
 	{
-		// Hangle windows messages
-		if( PeekMessage( &msg, nullptr, 0, 0, PM_REMOVE ) )
+		// Handle all of the windows messages which arrived during the last frame
+		while( PeekMessage( &msg, nullptr, 0, 0, PM_REMOVE ) )
 		{
 			if( msg.message == WM_QUIT )
+			{
+				quit = true;
 				break;
+			}
 
 			if( !TranslateAccelerator( msg.hwnd, hAccelTable, &msg ) )
 			{
@@ -1606,20 +2272,29 @@ int PlayWindow::HandleWindows( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPS
 			}
 		}
 
-		do
-		{
-			QueryPerformanceCounter( &now );
-			elapsedTime = ( now.QuadPart - lastDrawTime.QuadPart ) * 1000.0 / frequency.QuadPart;
+		if( quit )
+			break;
+
+		if( m_targetFrameRate > 0 )
+			WaitForFrameTime( hFrameTimer, lastDrawTime.QuadPart + frequency.QuadPart / m_targetFrameRate, frequency.QuadPart, spinTime );
 
-		} while( elapsedTime < 1000.0f / FRAMES_PER_SECOND );
+		QueryPerformanceCounter( &now );
+		elapsedTime = ( now.QuadPart - lastDrawTime.QuadPart ) * 1000.0 / frequency.QuadPart;
 
 		// Call the main game update function
 		quit = MainGameUpdate( static_cast<float>( elapsedTime ) / 1000.0f );
 		lastDrawTime = now;
 
-		DwmFlush(); // Waits for DWM compositor to finish
+		if( m_targetFrameRate > 0 )
+			DwmFlush(); // Waits for DWM compositor to finish
 	}
 
+	if( hFrameTimer )
+		CloseHandle( hFrameTimer );
+
+	if( raisedTimerResolution )
+		timeEndPeriod( 1 );
+
 	// Call the main game cleanup function
 	MainGameExit();
 
@@ -1637,6 +2312,8 @@ LRESULT CALLBACK PlayWindow::WndProc( HWND hWnd, UINT message, WPARAM wParam, LP
 			PAINTSTRUCT ps;
 			BeginPaint( hWnd, &ps );
 			EndPaint( hWnd, &ps );
+			if( s_pInstance )
+				s_pInstance->m_bFullPresent = true;
 			break;
 
 		case WM_DESTROY:
@@ -1675,7 +2352,7 @@ LRESULT CALLBACK PlayWindow::WndProc( HWND hWnd, UINT message, WPARAM wParam, LP
 	return 0;
 }
 
-double PlayWindow::Present( void )
+double PlayWindow::Present( int top, int bottom )
 {
 	LARGE_INTEGER frequency;
 	LARGE_INTEGER before;
@@ -1694,13 +2371,23 @@ double PlayWindow::Present( void )
 
 	BITMAPINFO bitmap_info{ bitmap_info_header, { 0,0,0,0 } };	// No palette data required for this bitmap
 
-	HDC hDC = GetDC( m_hWindow );
+	if( bottom < 0 || m_bFullPresent.exchange( false ) )
+	{
+		top = 0;
+		bottom = m_pPlayBuffer->height;
+	}
+
+	// There's nothing to copy if nothing has changed since the last present
+	if( top < bottom )
+	{
+		HDC hDC = GetDC( m_hWindow );
+
+		// Copy the changed rows to the window: GDI only implements up scaling using simple pixel duplication, but that's what we want
+		// Note that GDI+ DrawImage would do the same thing, but it's much slower! 
+		StretchDIBits( hDC, 0, top * m_scale, m_pPlayBuffer->width * m_scale, ( bottom - top ) * m_scale, 0, bottom + 1, m_pPlayBuffer->width, -( bottom - top ), m_pPlayBuffer->pPixels, &bitmap_info, DIB_RGB_COLORS, SRCCOPY ); // We flip h because Bitmaps store pixel data upside down.
 
-	// Copy the display buffer to the window: GDI only implements up scaling using simple pixel duplication, but that's what we want
-	// Note that GDI+ DrawImage would do the same thing, but it's much slower! 
-	StretchDIBits( hDC, 0, 0, m_pPlayBuffer->width * m_scale, m_pPlayBuffer->height * m_scale, 0, m_pPlayBuffer->height + 1, m_pPlayBuffer->width, -m_pPlayBuffer->height, m_pPlayBuffer->pPixels, &bitmap_info, DIB_RGB_COLORS, SRCCOPY ); // We flip h because Bitmaps store pixel data upside down.
-	
-	ReleaseDC( m_hWindow, hDC );
+		ReleaseDC( m_hWindow, hDC );
+	}
 
 	QueryPerformanceCounter( &after );
 
@@ -1792,172 +2479,1430 @@ int PlayWindow::LoadPNGImage( std::string& fileAndPath, PixelData& destImage )
 	return 1;
 }
 
+std::string PlayNativePath( const std::string& path )
+{
+	return path;
+}
+
+#else
+
 //********************************************************************************************************************************
-// Miscellaneous functions
+// Headless functions
 //********************************************************************************************************************************
 
-void AssertFailMessage( const char* message, const char* file, long line )
+int PlayWindow::HandleHeadless()
 {
-	// file - the file in which the assertion failed ( __FILE__ )
-	// line - the line of code where the assertion failed ( __LINE__ )
-	std::filesystem::path p = file;
-	std::string s = p.filename().string() + " : LINE " + std::to_string( line );
-	s += "\n" + std::string( message );
-	int wide_count = MultiByteToWideChar( CP_UTF8, 0, s.c_str(), -1, NULL, 0 );
-	wchar_t* wide = new wchar_t[wide_count];
-	MultiByteToWideChar( CP_UTF8, 0, s.c_str(), -1, wide, wide_count );
-	MessageBox( NULL, wide, (LPCWSTR)L"Assertion Failure", MB_ICONWARNING );
-	delete[] wide;
+	bool quit = false;
+
+	while( !quit && ( m_frameLimit <= 0 || m_frame < m_frameLimit ) )
+	{
+		ApplyScriptedInput();
+
+		// Call the main game update function with the injected time rather than waiting for the real time to pass
+		float elapsedTime = m_clock ? m_clock( m_frame ) : 1.0f / FRAMES_PER_SECOND;
+		quit = MainGameUpdate( elapsedTime );
+		m_frame++;
+	}
+
+	// Call the main game cleanup function
+	MainGameExit();
+
+	return PLAY_OK;
 }
 
-void DebugOutput( const char* s )
+void PlayWindow::ScriptKey( int frame, int vKey, bool down )
 {
-	OutputDebugStringA( s );
+	PLAY_ASSERT_MSG( frame >= m_frame, "Can't script input for a frame which has already started" );
+	PLAY_ASSERT_MSG( vKey >= 0 && vKey < 256, "Invalid virtual key code" );
+
+	ScriptedInput input;
+	input.frame = frame;
+	input.vKey = vKey;
+	input.down = down;
+
+	// Events for the same frame are applied in the order they were added
+	auto pos = std::upper_bound( m_vScriptedInput.begin() + m_nextInput, m_vScriptedInput.end(), frame, []( int f, const ScriptedInput& i ) { return f < i.frame; } );
+	m_vScriptedInput.insert( pos, input );
 }
 
-void DebugOutput( std::string s )
+void PlayWindow::ScriptMouse( int frame, Vector2f pos, bool left, bool right )
 {
-	OutputDebugStringA( s.c_str() );
+	PLAY_ASSERT_MSG( frame >= m_frame, "Can't script input for a frame which has already started" );
+
+	ScriptedInput input;
+	input.frame = frame;
+	input.isMouse = true;
+	input.mouse.pos = pos;
+	input.mouse.left = left;
+	input.mouse.right = right;
+
+	auto insertPos = std::upper_bound( m_vScriptedInput.begin() + m_nextInput, m_vScriptedInput.end(), frame, []( int f, const ScriptedInput& i ) { return f < i.frame; } );
+	m_vScriptedInput.insert( insertPos, input );
 }
 
-void TracePrintf( const char* file, int line, const char* fmt, ... )
+bool PlayWindow::LoadInputScript( const char* filename )
 {
-	constexpr size_t kMaxBufferSize = 512u;
-	char buffer[kMaxBufferSize];
+	std::ifstream script( PlayNativePath( filename ) );
+	if( !script.is_open() )
+		return false;
 
-	va_list args;
-	va_start( args, fmt );
-	// format should be double click-able in VS 
-	int len = sprintf_s( buffer, kMaxBufferSize, "%s(%d): ", file, line );
-	vsprintf_s( buffer + len, kMaxBufferSize - len, fmt, args );
-	DebugOutput( buffer );
-	va_end( args );
-}
+	std::string line;
+	while( std::getline( script, line ) )
+	{
+		std::istringstream event( line );
+		int frame = 0;
+		std::string type;
 
-//********************************************************************************************************************************
-// File:		PlayBlitter.cpp
-// Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
-// Platform:	Independent
-//********************************************************************************************************************************
+		if( !( event >> frame >> type ) )
+			continue; // Blank lines and comments
 
+		if( type == "key" )
+		{
+			int vKey = 0, down = 0;
+			if( event >> vKey >> down )
+				ScriptKey( frame, vKey, down != 0 );
+		}
+		else if( type == "mouse" )
+		{
+			float x = 0, y = 0;
+			int left = 0, right = 0;
+			if( event >> x >> y >> left >> right )
+				ScriptMouse( frame, { x, y }, left != 0, right != 0 );
+		}
+	}
 
-PlayBlitter::PlayBlitter( PixelData* pRenderTarget )
-{
-	m_pRenderTarget = pRenderTarget;
+	return true;
 }
 
+void PlayWindow::ApplyScriptedInput()
+{
+	for( ; m_nextInput < m_vScriptedInput.size() && m_vScriptedInput[m_nextInput].frame <= m_frame; m_nextInput++ )
+	{
+		const ScriptedInput& input = m_vScriptedInput[m_nextInput];
+
+		if( !input.isMouse )
+			m_keyDown[input.vKey] = input.down;
+		else if( m_pMouseData )
+			*m_pMouseData = input.mouse;
+	}
+}
 
-void PlayBlitter::DrawPixel( int posX, int posY, Pixel srcPix )
+double PlayWindow::Present( int top, int bottom )
 {
-	if( srcPix.a == 0x00 || posX < 0 || posX >= m_pRenderTarget->width || posY < 0 || posY >= m_pRenderTarget->height )
-		return;
+	UNREFERENCED_PARAMETER( top );
+	UNREFERENCED_PARAMETER( bottom );
 
-	Pixel* destPix = &m_pRenderTarget->pPixels[( posY * m_pRenderTarget->width ) + posX];
+	auto before = std::chrono::steady_clock::now();
 
-	if( srcPix.a == 0xFF ) // Completely opaque pixel - no need to blend
-	{
-		*destPix = srcPix.bits;
-	}
-	else
-	{
-		Pixel blendPix = *destPix;
-		float srcAlpha = srcPix.a / 255.0f;
-		float oneMinusSrcAlpha = 1.0f - srcAlpha;
+	// There's no window to copy to, but the buffer can be inspected
+	if( m_presentCallback )
+		m_presentCallback( *m_pPlayBuffer, m_presentedFrames );
 
-		blendPix.a = 0xFF;
-		blendPix.r = static_cast<uint8_t>( ( srcAlpha * srcPix.r ) + ( oneMinusSrcAlpha * blendPix.r ) );
-		blendPix.g = static_cast<uint8_t>( ( srcAlpha * srcPix.g ) + ( oneMinusSrcAlpha * blendPix.g ) );
-		blendPix.b = static_cast<uint8_t>( ( srcAlpha * srcPix.b ) + ( oneMinusSrcAlpha * blendPix.b ) );
+	m_presentedFrames++;
 
-		*destPix = blendPix.bits;
-	}
+	auto after = std::chrono::steady_clock::now();
 
-	return;
+	return std::chrono::duration<double, std::milli>( after - before ).count();
 }
 
-void PlayBlitter::DrawLine( int startX, int startY, int endX, int endY, Pixel pix )
+// Game code is written for Windows, so paths can use backslashes and don't always match the case of the files
+std::string PlayNativePath( const std::string& path )
 {
-	//Implementation of Bresenham's Line Drawing Algorithm
-	int dx = abs( endX - startX );
-	int sx = 1;
-	if( endX < startX ) { sx = -1; }
-
-	int dy = -abs( endY - startY );
-	int sy = 1;
-	if( endY < startY ) { sy = -1; }
+	std::string native = path;
+	std::replace( native.begin(), native.end(), '\\', '/' );
 
-	int err = dx + dy;
+	if( native.empty() || std::filesystem::exists( native ) )
+		return native;
 
-	if( err == 0 ) return;
+	// Resolve each part of the path in turn, looking for a case insensitive match if there isn't an exact one
+	auto lower = []( std::string s ) { for( char& c : s ) c = static_cast<char>( tolower( static_cast<unsigned char>( c ) ) ); return s; };
+	std::filesystem::path resolved = native[0] == '/' ? "/" : "";
+	std::stringstream parts( native );
+	std::string part;
 
-	int x = startX;
-	int y = startY;
-
-	while( true )
+	while( std::getline( parts, part, '/' ) )
 	{
-		DrawPixel( x, y, pix );
+		if( part.empty() )
+			continue;
 
-		if( x == endX && y == endY )
-			break;
+		std::filesystem::path next = resolved / part;
+		std::filesystem::path directory = resolved.empty() ? "." : resolved;
+		std::error_code error;
 
-		int e2 = 2 * err;
-		if( e2 >= dy )
-		{
-			err += dy;
-			x += sx;
-		}
-		if( e2 <= dx )
+		if( !std::filesystem::exists( next, error ) && std::filesystem::is_directory( directory, error ) )
 		{
-			err += dx;
-			y += sy;
+			for( const auto& entry : std::filesystem::directory_iterator( directory, error ) )
+			{
+				if( lower( entry.path().filename().string() ) == lower( part ) )
+				{
+					next = resolved / entry.path().filename();
+					break;
+				}
+			}
 		}
+
+		resolved = next;
 	}
+
+	std::string result = resolved.string();
+	if( native.back() == '/' )
+		result += '/';
+
+	return result;
 }
 
 //********************************************************************************************************************************
-// Function:	BlitPixels - draws image data with and without a global alpha multiply
-// Parameters:	spriteId = the id of the sprite to draw
-//				xpos, ypos = the position you want to draw the sprite
-//				frameIndex = which frame of the animation to draw (wrapped)
-// Notes:		Alpha multiply approach is relatively unoptimized
+// PNG decoding: a minimal decoder for 8-bit non-interlaced PNGs which replaces GDI+ in headless builds
 //********************************************************************************************************************************
-void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const
+
+// The state of the inflate (RFC 1951) decompressor reading the zlib stream from the PNG's IDAT chunks
+struct InflateStream
 {
-	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
+	const uint8_t* pData{ nullptr };
+	size_t size{ 0 };
+	size_t pos{ 0 };
+	uint32_t bitBuffer{ 0 };
+	int bitCount{ 0 };
+	bool error{ false }; // Set if the data runs out or is invalid
+};
 
-	// Nothing within the display buffer to draw
-	if( blitX > m_pRenderTarget->width || blitX + blitWidth < 0 || blitY > m_pRenderTarget->height || blitY + blitHeight < 0 )
-		return;
+// A canonical Huffman code: the number of codes of each length and the symbols in code order
+struct InflateHuffman
+{
+	short count[16]{ 0 };
+	short symbol[288]{ 0 };
+};
 
-	// Work out if we need to clip to the display buffer (and by how much)
-	int xClipStart = -blitX;
-	if( xClipStart < 0 ) { xClipStart = 0; }
+static int InflateBits( InflateStream& s, int need )
+{
+	uint32_t value = s.bitBuffer;
 
-	int xClipEnd = ( blitX + blitWidth ) - m_pRenderTarget->width;
-	if( xClipEnd < 0 ) { xClipEnd = 0; }
+	while( s.bitCount < need )
+	{
+		if( s.pos >= s.size )
+		{
+			s.error = true;
+			return 0;
+		}
+		value |= static_cast<uint32_t>( s.pData[s.pos++] ) << s.bitCount;
+		s.bitCount += 8;
+	}
 
-	int yClipStart = -blitY;
-	if( yClipStart < 0 ) { yClipStart = 0; }
+	s.bitBuffer = value >> need;
+	s.bitCount -= need;
 
-	int yClipEnd = ( blitY + blitHeight ) - m_pRenderTarget->height;
-	if( yClipEnd < 0 ) { yClipEnd = 0; }
+	return static_cast<int>( value & ( ( 1u << need ) - 1 ) );
+}
 
-	// Set up the source and destination pointers based on clipping
-	int destOffset = ( m_pRenderTarget->width * ( blitY + yClipStart ) ) + ( blitX + xClipStart );
-	uint32_t* destPixels = &m_pRenderTarget->pPixels->bits + destOffset;
+static int InflateDecode( InflateStream& s, const InflateHuffman& h )
+{
+	int code = 0, first = 0, index = 0;
 
-	int srcClipOffset = ( srcPixelData.width * yClipStart ) + xClipStart;
-	uint32_t* srcPixels = &srcPixelData.pPixels->bits + srcOffset + srcClipOffset;
+	for( int length = 1; length < 16; length++ )
+	{
+		code |= InflateBits( s, 1 );
+		int count = h.count[length];
 
-	// Work out in advance how much we need to add to src and dest to reach the next row 
-	int destInc = m_pRenderTarget->width - blitWidth + xClipEnd + xClipStart;
-	int srcInc = srcPixelData.width - blitWidth + xClipEnd + xClipStart;
+		if( code - count < first )
+			return h.symbol[index + ( code - first )];
 
-	//Work out final pixel in destination.
-	int destColOffset = ( m_pRenderTarget->width * ( blitHeight - yClipEnd - yClipStart - 1 ) ) + ( blitWidth - xClipEnd - xClipStart );
-	uint32_t* destColEnd = destPixels + destColOffset;
+		index += count;
+		first = ( first + count ) << 1;
+		code <<= 1;
+	}
 
-	//How many pixels per row in sprite.
+	s.error = true;
+	return -1;
+}
+
+static bool InflateBuildHuffman( InflateHuffman& h, const short* lengths, int n )
+{
+	for( short& c : h.count ) c = 0;
+	for( int i = 0; i < n; i++ )
+		h.count[lengths[i]]++;
+
+	// Reject over-subscribed codes (incomplete codes are allowed)
+	int left = 1;
+	for( int length = 1; length < 16; length++ )
+	{
+		left = ( left << 1 ) - h.count[length];
+		if( left < 0 )
+			return false;
+	}
+
+	short offsets[16]{ 0 };
+	for( int length = 1; length < 15; length++ )
+		offsets[length + 1] = offsets[length] + h.count[length];
+
+	for( int i = 0; i < n; i++ )
+	{
+		if( lengths[i] != 0 )
+			h.symbol[offsets[lengths[i]]++] = static_cast<short>( i );
+	}
+
+	return true;
+}
+
+static bool InflateCodes( InflateStream& s, std::vector<uint8_t>& out, const InflateHuffman& lengthCode, const InflateHuffman& distanceCode )
+{
+	static const short lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const short lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const short distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const short distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	for( ;; )
+	{
+		int symbol = InflateDecode( s, lengthCode );
+		if( s.error )
+			return false;
+
+		if( symbol < 256 )
+		{
+			out.push_back( static_cast<uint8_t>( symbol ) );
+		}
+		else if( symbol == 256 )
+		{
+			return true; // End of block
+		}
+		else
+		{
+			symbol -= 257;
+			if( symbol >= 29 )
+				return false;
+			int length = lengthBase[symbol] + InflateBits( s, lengthExtra[symbol] );
+
+			symbol = InflateDecode( s, distanceCode );
+			if( s.error || symbol < 0 || symbol >= 30 )
+				return false;
+			size_t distance = distanceBase[symbol] + InflateBits( s, distanceExtra[symbol] );
+			if( s.error || distance > out.size() )
+				return false;
+
+			// The copy can overlap the bytes it produces, so it has to go one byte at a time
+			size_t from = out.size() - distance;
+			for( int i = 0; i < length; i++ )
+				out.push_back( out[from + i] );
+		}
+	}
+}
+
+// Decompresses a zlib stream, returning false if it's invalid
+static bool Inflate( const uint8_t* pData, size_t size, std::vector<uint8_t>& out )
+{
+	// The zlib header must say deflate with no preset dictionary
+	if( size < 2 || ( pData[0] & 0x0F ) != 8 || ( pData[1] & 0x20 ) || ( ( pData[0] << 8 ) | pData[1] ) % 31 != 0 )
+		return false;
+
+	InflateStream s;
+	s.pData = pData + 2;
+	s.size = size - 2;
+
+	int last = 0;
+	do
+	{
+		last = InflateBits( s, 1 );
+		int type = InflateBits( s, 2 );
+		if( s.error )
+			return false;
+
+		if( type == 0 )
+		{
+			// A stored block starts on the next byte boundary
+			s.bitBuffer = 0;
+			s.bitCount = 0;
+			if( s.pos + 4 > s.size )
+				return false;
+			size_t length = s.pData[s.pos] | ( s.pData[s.pos + 1] << 8 );
+			s.pos += 4;
+			if( s.pos + length > s.size )
+				return false;
+			out.insert( out.end(), s.pData + s.pos, s.pData + s.pos + length );
+			s.pos += length;
+		}
+		else if( type == 1 )
+		{
+			static InflateHuffman fixedLengthCode, fixedDistanceCode;
+			static bool fixedBuilt = false;
+			if( !fixedBuilt )
+			{
+				short lengths[288];
+				for( int i = 0; i < 288; i++ )
+					lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+				InflateBuildHuffman( fixedLengthCode, lengths, 288 );
+				for( int i = 0; i < 30; i++ )
+					lengths[i] = 5;
+				InflateBuildHuffman( fixedDistanceCode, lengths, 30 );
+				fixedBuilt = true;
+			}
+
+			if( !InflateCodes( s, out, fixedLengthCode, fixedDistanceCode ) )
+				return false;
+		}
+		else if( type == 2 )
+		{
+			static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+			int lengthCount = InflateBits( s, 5 ) + 257;
+			int distanceCount = InflateBits( s, 5 ) + 1;
+			int codeCount = InflateBits( s, 4 ) + 4;
+			if( s.error || lengthCount > 286 || distanceCount > 30 )
+				return false;
+
+			// The code lengths are themselves Huffman coded
+			short lengths[320]{ 0 };
+			for( int i = 0; i < codeCount; i++ )
+				lengths[order[i]] = static_cast<short>( InflateBits( s, 3 ) );
+
+			InflateHuffman lengthCode, distanceCode;
+			if( !InflateBuildHuffman( lengthCode, lengths, 19 ) )
+				return false;
+
+			int index = 0;
+			while( index < lengthCount + distanceCount )
+			{
+				int symbol = InflateDecode( s, lengthCode );
+				if( s.error || symbol < 0 )
+					return false;
+
+				if( symbol < 16 )
+				{
+					lengths[index++] = static_cast<short>( symbol );
+					continue;
+				}
+
+				// Symbols 16-18 repeat the previous length or zero
+				short value = 0;
+				int repeat = 0;
+				if( symbol == 16 )
+				{
+					if( index == 0 )
+						return false;
+					value = lengths[index - 1];
+					repeat = 3 + InflateBits( s, 2 );
+				}
+				else if( symbol == 17 )
+				{
+					repeat = 3 + InflateBits( s, 3 );
+				}
+				else
+				{
+					repeat = 11 + InflateBits( s, 7 );
+				}
+
+				if( s.error || index + repeat > lengthCount + distanceCount )
+					return false;
+				while( repeat-- )
+					lengths[index++] = value;
+			}
+
+			if( lengths[256] == 0 )
+				return false; // There must be an end of block code
+
+			if( !InflateBuildHuffman( lengthCode, lengths, lengthCount ) || !InflateBuildHuffman( distanceCode, lengths + lengthCount, distanceCount ) )
+				return false;
+
+			if( !InflateCodes( s, out, lengthCode, distanceCode ) )
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	} while( !last );
+
+	return true;
+}
+
+// The Paeth predictor used by PNG filter type 4
+static uint8_t PaethPredictor( int a, int b, int c )
+{
+	int p = a + b - c;
+	int pa = abs( p - a );
+	int pb = abs( p - b );
+	int pc = abs( p - c );
+
+	if( pa <= pb && pa <= pc )
+		return static_cast<uint8_t>( a );
+	if( pb <= pc )
+		return static_cast<uint8_t>( b );
+	return static_cast<uint8_t>( c );
+}
+
+static uint32_t ReadBigEndian( const uint8_t* p )
+{
+	return ( static_cast<uint32_t>( p[0] ) << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3];
+}
+
+// Decodes a PNG file into 32-bit ARGB pixels (not pre-multiplied), or just reads its size if pPixels is null
+// > Returns 1 on success or a negative value on failure, like the GDI+ version
+static int DecodePNG( const std::string& fileAndPath, int& width, int& height, std::vector<Pixel>* pPixels )
+{
+	std::ifstream file( PlayNativePath( fileAndPath ), std::ios::binary );
+	if( !file.is_open() )
+		return -1;
+
+	std::vector<uint8_t> data( ( std::istreambuf_iterator<char>( file ) ), std::istreambuf_iterator<char>() );
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+	if( data.size() < 33 || memcmp( data.data(), signature, 8 ) != 0 || memcmp( data.data() + 12, "IHDR", 4 ) != 0 )
+		return -2;
+
+	width = static_cast<int>( ReadBigEndian( data.data() + 16 ) );
+	height = static_cast<int>( ReadBigEndian( data.data() + 20 ) );
+	int bitDepth = data[24];
+	int colourType = data[25];
+	int interlace = data[28];
+
+	if( !pPixels )
+		return 1;
+
+	// Only the formats exported by typical art tools are supported: 8 bits per channel and no interlacing
+	int channels = 0;
+	switch( colourType )
+	{
+		case 0: channels = 1; break; // Greyscale
+		case 2: channels = 3; break; // RGB
+		case 3: channels = 1; break; // Palette
+		case 4: channels = 2; break; // Greyscale and alpha
+		case 6: channels = 4; break; // RGBA
+	}
+	if( bitDepth != 8 || channels == 0 || interlace != 0 || width <= 0 || height <= 0 )
+		return -3;
+
+	// Gather the compressed image data and the palette
+	std::vector<uint8_t> compressed;
+	uint32_t palette[256];
+	for( uint32_t& c : palette ) c = 0xFF000000;
+
+	for( size_t pos = 8; pos + 12 <= data.size(); )
+	{
+		size_t length = ReadBigEndian( data.data() + pos );
+		const uint8_t* pType = data.data() + pos + 4;
+		const uint8_t* pChunk = data.data() + pos + 8;
+		if( pos + 12 + length > data.size() )
+			return -4;
+
+		if( memcmp( pType, "IDAT", 4 ) == 0 )
+		{
+			compressed.insert( compressed.end(), pChunk, pChunk + length );
+		}
+		else if( memcmp( pType, "PLTE", 4 ) == 0 )
+		{
+			for( size_t i = 0; i < length / 3 && i < 256; i++ )
+				palette[i] = 0xFF000000 | ( pChunk[i * 3] << 16 ) | ( pChunk[i * 3 + 1] << 8 ) | pChunk[i * 3 + 2];
+		}
+		else if( memcmp( pType, "tRNS", 4 ) == 0 && colourType == 3 )
+		{
+			for( size_t i = 0; i < length && i < 256; i++ )
+				palette[i] = ( palette[i] & 0x00FFFFFF ) | ( static_cast<uint32_t>( pChunk[i] ) << 24 );
+		}
+		else if( memcmp( pType, "IEND", 4 ) == 0 )
+		{
+			break;
+		}
+
+		pos += 12 + length;
+	}
+
+	size_t stride = static_cast<size_t>( width ) * channels;
+	std::vector<uint8_t> filtered;
+	filtered.reserve( ( stride + 1 ) * height );
+	if( !Inflate( compressed.data(), compressed.size(), filtered ) || filtered.size() < ( stride + 1 ) * height )
+		return -5;
+
+	// Undo the filter on each row, which predicts each byte from the bytes to the left and above
+	std::vector<uint8_t> previousRow( stride, 0 );
+	std::vector<uint8_t> row( stride );
+	pPixels->resize( static_cast<size_t>( width ) * height );
+
+	for( int y = 0; y < height; y++ )
+	{
+		const uint8_t* pFiltered = filtered.data() + ( stride + 1 ) * y;
+		int filter = pFiltered[0];
+		pFiltered++;
+
+		for( size_t x = 0; x < stride; x++ )
+		{
+			int left = x >= static_cast<size_t>( channels ) ? row[x - channels] : 0;
+			int above = previousRow[x];
+			int aboveLeft = x >= static_cast<size_t>( channels ) ? previousRow[x - channels] : 0;
+
+			switch( filter )
+			{
+				case 0: row[x] = pFiltered[x]; break;
+				case 1: row[x] = static_cast<uint8_t>( pFiltered[x] + left ); break;
+				case 2: row[x] = static_cast<uint8_t>( pFiltered[x] + above ); break;
+				case 3: row[x] = static_cast<uint8_t>( pFiltered[x] + ( ( left + above ) >> 1 ) ); break;
+				case 4: row[x] = static_cast<uint8_t>( pFiltered[x] + PaethPredictor( left, above, aboveLeft ) ); break;
+				default: return -6;
+			}
+		}
+
+		Pixel* pDest = pPixels->data() + static_cast<size_t>( width ) * y;
+		for( int x = 0; x < width; x++ )
+		{
+			const uint8_t* p = row.data() + static_cast<size_t>( x ) * channels;
+			switch( colourType )
+			{
+				case 0: pDest[x].bits = 0xFF000000 | ( p[0] << 16 ) | ( p[0] << 8 ) | p[0]; break;
+				case 2: pDest[x].bits = 0xFF000000 | ( p[0] << 16 ) | ( p[1] << 8 ) | p[2]; break;
+				case 3: pDest[x].bits = palette[p[0]]; break;
+				case 4: pDest[x].bits = ( static_cast<uint32_t>( p[1] ) << 24 ) | ( p[0] << 16 ) | ( p[0] << 8 ) | p[0]; break;
+				case 6: pDest[x].bits = ( static_cast<uint32_t>( p[3] ) << 24 ) | ( p[0] << 16 ) | ( p[1] << 8 ) | p[2]; break;
+			}
+		}
+
+		row.swap( previousRow );
+	}
+
+	return 1;
+}
+
+//********************************************************************************************************************************
+// Loading functions
+//********************************************************************************************************************************
+
+int PlayWindow::ReadPNGImage( std::string& fileAndPath, int& width, int& height )
+{
+	return DecodePNG( fileAndPath, width, height, nullptr );
+}
+
+int PlayWindow::LoadPNGImage( std::string& fileAndPath, PixelData& destImage )
+{
+	std::vector<Pixel> pixels;
+	int status = DecodePNG( fileAndPath, destImage.width, destImage.height, &pixels );
+
+	if( status < 0 )
+		return status;
+
+	destImage.pPixels = new Pixel[destImage.width * destImage.height];
+	memcpy( destImage.pPixels, pixels.data(), sizeof( Pixel ) * destImage.width * destImage.height );
+
+	return 1;
+}
+
+#endif
+
+//********************************************************************************************************************************
+// Miscellaneous functions
+//********************************************************************************************************************************
+
+#ifndef PLAY_HEADLESS
+void AssertFailMessage( const char* message, const char* file, long line )
+{
+	// file - the file in which the assertion failed ( __FILE__ )
+	// line - the line of code where the assertion failed ( __LINE__ )
+	std::filesystem::path p = file;
+	std::string s = p.filename().string() + " : LINE " + std::to_string( line );
+	s += "\n" + std::string( message );
+	int wide_count = MultiByteToWideChar( CP_UTF8, 0, s.c_str(), -1, NULL, 0 );
+	wchar_t* wide = new wchar_t[wide_count];
+	MultiByteToWideChar( CP_UTF8, 0, s.c_str(), -1, wide, wide_count );
+	MessageBox( NULL, wide, (LPCWSTR)L"Assertion Failure", MB_ICONWARNING );
+	delete[] wide;
+}
+
+void DebugOutput( const char* s )
+{
+	OutputDebugStringA( s );
+}
+
+void DebugOutput( std::string s )
+{
+	OutputDebugStringA( s.c_str() );
+}
+#else
+void AssertFailMessage( const char* message, const char* file, long line )
+{
+	std::filesystem::path p = file;
+	fprintf( stderr, "Assertion Failure: %s : LINE %ld\n%s\n", p.filename().string().c_str(), line, message );
+	fflush( stderr );
+}
+
+void DebugOutput( const char* s )
+{
+	fputs( s, stderr );
+}
+
+void DebugOutput( std::string s )
+{
+	fputs( s.c_str(), stderr );
+}
+#endif
+
+void TracePrintf( const char* file, int line, const char* fmt, ... )
+{
+	constexpr size_t kMaxBufferSize = 512u;
+	char buffer[kMaxBufferSize];
+
+	va_list args;
+	va_start( args, fmt );
+	// format should be double click-able in VS 
+	int len = snprintf( buffer, kMaxBufferSize, "%s(%d): ", file, line );
+	vsnprintf( buffer + len, kMaxBufferSize - len, fmt, args );
+	DebugOutput( buffer );
+	va_end( args );
+}
+
+//********************************************************************************************************************************
+// File:		PlayBlitter.cpp
+// Description:	A software pixel renderer for drawing 2D primitives into a PixelData buffer
+// Platform:	Independent
+//********************************************************************************************************************************
+
+
+PlayBlitter::PlayBlitter( PixelData* pRenderTarget )
+{
+	m_pRenderTarget = pRenderTarget;
+	ResetClipRect();
+}
+
+void PlayBlitter::SetClipRect( int left, int top, int right, int bottom )
+{
+	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
+	m_clipLeft = std::max( left, 0 );
+	m_clipTop = std::max( top, 0 );
+	m_clipRight = std::min( right, m_pRenderTarget->width );
+	m_clipBottom = std::min( bottom, m_pRenderTarget->height );
+}
+
+void PlayBlitter::ResetClipRect()
+{
+	m_clipLeft = m_clipTop = 0;
+	m_clipRight = m_pRenderTarget ? m_pRenderTarget->width : 0;
+	m_clipBottom = m_pRenderTarget ? m_pRenderTarget->height : 0;
+}
+
+
+void PlayBlitter::DrawPixel( int posX, int posY, Pixel srcPix ) const
+{
+	if( posX < m_clipLeft || posX >= m_clipRight || posY < m_clipTop || posY >= m_clipBottom )
+		return;
+
+	FillRow( &m_pRenderTarget->pPixels[( posY * m_pRenderTarget->width ) + posX].bits, 1, srcPix );
+}
+
+void PlayBlitter::FillRow( uint32_t* pDest, int width, Pixel pix )
+{
+	if( pix.a == 0x00 )
+		return;
+
+	if( pix.a == 0xFF ) // Completely opaque - no need to blend
+	{
+		std::fill_n( pDest, width, pix.bits );
+		return;
+	}
+
+	// The source half of the blend is the same for every pixel
+	float srcAlpha = pix.a / 255.0f;
+	float oneMinusSrcAlpha = 1.0f - srcAlpha;
+	float srcRed = srcAlpha * pix.r;
+	float srcGreen = srcAlpha * pix.g;
+	float srcBlue = srcAlpha * pix.b;
+
+	for( int x = 0; x < width; x++ )
+	{
+		Pixel blendPix = pDest[x];
+		blendPix.a = 0xFF;
+		blendPix.r = static_cast<uint8_t>( srcRed + ( oneMinusSrcAlpha * blendPix.r ) );
+		blendPix.g = static_cast<uint8_t>( srcGreen + ( oneMinusSrcAlpha * blendPix.g ) );
+		blendPix.b = static_cast<uint8_t>( srcBlue + ( oneMinusSrcAlpha * blendPix.b ) );
+		pDest[x] = blendPix.bits;
+	}
+}
+
+void PlayBlitter::FillRect( int left, int top, int right, int bottom, Pixel pix ) const
+{
+	left = std::max( left, m_clipLeft );
+	top = std::max( top, m_clipTop );
+	right = std::min( right, m_clipRight );
+	bottom = std::min( bottom, m_clipBottom );
+
+	for( int y = top; y < bottom && left < right; y++ )
+		FillRow( &m_pRenderTarget->pPixels[( static_cast<size_t>( m_pRenderTarget->width ) * y ) + left].bits, right - left, pix );
+}
+
+void PlayBlitter::DrawCircle( int centreX, int centreY, int radius, Pixel pix ) const
+{
+	// Reject circles which are completely outside the clipping rectangle (the last step can overshoot |radius| by one)
+	int extent = abs( radius ) + 1;
+	if( centreX + extent < m_clipLeft || centreX - extent >= m_clipRight || centreY + extent < m_clipTop || centreY - extent >= m_clipBottom )
+		return;
+
+	// Draws the offset points from the centre in all octants (points on the diagonals and axes are drawn twice)
+	auto drawOctants = [&]( int offX, int offY )
+	{
+		DrawPixel( centreX + offX, centreY + offY, pix );
+		DrawPixel( centreX - offX, centreY + offY, pix );
+		DrawPixel( centreX + offX, centreY - offY, pix );
+		DrawPixel( centreX - offX, centreY - offY, pix );
+		DrawPixel( centreX - offY, centreY + offX, pix );
+		DrawPixel( centreX + offY, centreY - offX, pix );
+		DrawPixel( centreX - offY, centreY - offX, pix );
+		DrawPixel( centreX + offY, centreY + offX, pix );
+	};
+
+	int dx = 0;
+	int dy = radius;
+
+	int d = 3 - 2 * radius;
+	drawOctants( dx, dy );
+
+	while( dy >= dx )
+	{
+		dx++;
+		if( d > 0 )
+		{
+			dy--;
+			d = d + 4 * ( dx - dy ) + 10;
+		}
+		else
+		{
+			d = d + 4 * dx + 6;
+		}
+		drawOctants( dx, dy );
+	}
+}
+
+//********************************************************************************************************************************
+// Function:	DrawLine - draws a line of pixels into the render target
+// Parameters:	startX, startY, endX, endY = the end points of the line (both included)
+//				pix = the colour of the line
+// Notes:		Draws the same pixels as Bresenham's algorithm, but works out the minor axis position of the pixel at each step
+//				along the major axis directly: offset = floor( ( 2 * minorDelta * step + majorDelta ) / ( 2 * majorDelta ) ).
+//				Lines with both ends on the same side outside the clipping rectangle are rejected using Cohen-Sutherland
+//				outcodes. Otherwise the range of steps inside the rectangle is worked out exactly from the same formula,
+//				rather than clipping the end points, so a line split across deferred drawing tiles has no seams.
+//********************************************************************************************************************************
+void PlayBlitter::DrawLine( int startX, int startY, int endX, int endY, Pixel pix ) const
+{
+	auto outcode = [this]( int x, int y )
+	{
+		return ( x < m_clipLeft ? 1 : 0 ) | ( x >= m_clipRight ? 2 : 0 ) | ( y < m_clipTop ? 4 : 0 ) | ( y >= m_clipBottom ? 8 : 0 );
+	};
+
+	if( ( outcode( startX, startY ) & outcode( endX, endY ) ) != 0 || pix.a == 0x00 )
+		return;
+
+	// Zero length lines aren't drawn
+	if( startX == endX && startY == endY )
+		return;
+
+	bool xMajor = abs( endX - startX ) >= abs( endY - startY );
+	int majorStart = xMajor ? startX : startY;
+	int minorStart = xMajor ? startY : startX;
+	int majorDir = ( xMajor ? endX < startX : endY < startY ) ? -1 : 1;
+	int minorDir = ( xMajor ? endY < startY : endX < startX ) ? -1 : 1;
+	long long majorDelta = xMajor ? abs( endX - startX ) : abs( endY - startY );
+	long long minorDelta = xMajor ? abs( endY - startY ) : abs( endX - startX );
+
+	auto floorDiv = []( long long a, long long b ) { return ( a / b ) - ( ( a % b != 0 && a < 0 ) ? 1 : 0 ); };
+	auto ceilDiv = [&floorDiv]( long long a, long long b ) { return -floorDiv( -a, b ); };
+
+	// The range of offsets from the start which lie inside the clipping rectangle along an axis
+	auto clipOffsets = []( int start, int dir, int clipMin, int clipMax, long long& offsetMin, long long& offsetMax )
+	{
+		offsetMin = dir > 0 ? clipMin - start : start - ( clipMax - 1 );
+		offsetMax = dir > 0 ? ( clipMax - 1 ) - start : start - clipMin;
+	};
+
+	long long majorMin, majorMax, minorMin, minorMax;
+	clipOffsets( majorStart, majorDir, xMajor ? m_clipLeft : m_clipTop, xMajor ? m_clipRight : m_clipBottom, majorMin, majorMax );
+	clipOffsets( minorStart, minorDir, xMajor ? m_clipTop : m_clipLeft, xMajor ? m_clipBottom : m_clipRight, minorMin, minorMax );
+
+	long long firstStep = std::max( 0LL, majorMin );
+	long long lastStep = std::min( majorDelta, majorMax );
+
+	if( minorDelta == 0 )
+	{
+		if( minorMin > 0 || minorMax < 0 )
+			return;
+	}
+	else
+	{
+		// Invert the minor offset formula to find the steps where the offset is within the clipping rectangle
+		firstStep = std::max( firstStep, ceilDiv( ( 2 * majorDelta * minorMin ) - majorDelta, 2 * minorDelta ) );
+		lastStep = std::min( lastStep, ceilDiv( ( 2 * majorDelta * minorMax ) + majorDelta, 2 * minorDelta ) - 1 );
+	}
+
+	if( firstStep > lastStep )
+		return;
+
+	// Step along the major axis, carrying the remainder of the minor offset formula
+	long long numerator = ( 2 * minorDelta * firstStep ) + majorDelta;
+	int minorOffset = static_cast<int>( numerator / ( 2 * majorDelta ) );
+	long long remainder = numerator % ( 2 * majorDelta );
+
+	int majorStride = xMajor ? 1 : m_pRenderTarget->width;
+	int minorStride = xMajor ? m_pRenderTarget->width : 1;
+	int major = majorStart + ( majorDir * static_cast<int>( firstStep ) );
+	int minor = minorStart + ( minorDir * minorOffset );
+	uint32_t* pDest = &m_pRenderTarget->pPixels->bits + ( static_cast<ptrdiff_t>( major ) * majorStride ) + ( static_cast<ptrdiff_t>( minor ) * minorStride );
+
+	for( long long step = firstStep; step <= lastStep; step++ )
+	{
+		FillRow( pDest, 1, pix );
+
+		pDest += majorDir * majorStride;
+		remainder += 2 * minorDelta;
+		if( remainder >= 2 * majorDelta )
+		{
+			remainder -= 2 * majorDelta;
+			pDest += minorDir * minorStride;
+		}
+	}
+}
+
+//********************************************************************************************************************************
+// SIMD kernel selection
+//********************************************************************************************************************************
+
+#ifdef PLAY_SIMD
+
+// Reads the CPU feature flags for the given leaf and subleaf into EAX, EBX, ECX and EDX
+static void ReadCpuid( int info[4], int leaf, int subleaf )
+{
+#ifdef PLAY_SIMD_GNU
+	unsigned int a, b, c, d;
+	__cpuid_count( leaf, subleaf, a, b, c, d );
+	info[0] = static_cast<int>( a );
+	info[1] = static_cast<int>( b );
+	info[2] = static_cast<int>( c );
+	info[3] = static_cast<int>( d );
+#else
+	__cpuidex( info, leaf, subleaf );
+#endif
+}
+
+// Reads the register states which the OS preserves between context switches
+static unsigned long long ReadXcr0()
+{
+#ifdef PLAY_SIMD_GNU
+	unsigned int eax, edx;
+	__asm__ __volatile__( "xgetbv" : "=a"( eax ), "=d"( edx ) : "c"( 0 ) );
+	return ( static_cast<unsigned long long>( edx ) << 32 ) | eax;
+#else
+	return _xgetbv( 0 );
+#endif
+}
+
+#endif
+
+PlayBlitter::SimdLevel PlayBlitter::s_simdLevel = PlayBlitter::DetectSimdLevel();
+
+PlayBlitter::SimdLevel PlayBlitter::DetectSimdLevel()
+{
+#ifdef PLAY_SIMD
+	int info[4]{ 0 };
+	ReadCpuid( info, 0, 0 );
+	int maxLeaf = info[0];
+
+	ReadCpuid( info, 1, 0 );
+	bool sse2 = ( info[3] & ( 1 << 26 ) ) != 0;
+	bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+	bool avx = ( info[2] & ( 1 << 28 ) ) != 0;
+
+	if( !sse2 )
+		return SIMD_NONE;
+
+	// AVX2 also needs the OS to preserve the YMM registers between context switches
+	if( maxLeaf >= 7 && osxsave && avx && ( ReadXcr0() & 0x6 ) == 0x6 )
+	{
+		ReadCpuid( info, 7, 0 );
+		if( info[1] & ( 1 << 5 ) )
+			return SIMD_AVX2;
+	}
+
+	return SIMD_SSE2;
+#else
+	return SIMD_NONE;
+#endif
+}
+
+void PlayBlitter::SetSimdLevel( SimdLevel level )
+{
+	s_simdLevel = std::min( level, DetectSimdLevel() );
+}
+
+#ifdef PLAY_SIMD
+
+// Blends 4 pre-multiplied pixels into the destination using exactly the same sums as the scalar kernel
+// > The 4-bit channel products never overflow a byte, so a 16-bit multiply gives the same result as the scalar 32-bit one
+static inline void BlendPreMultiplied4( uint32_t* pDest, const uint32_t* pSrc )
+{
+	__m128i src = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc ) );
+	__m128i dest = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pDest ) );
+
+	__m128i invAlpha = _mm_srli_epi32( src, 28 );
+	__m128i multiplier = _mm_or_si128( invAlpha, _mm_slli_epi32( invAlpha, 16 ) );
+	__m128i destNibbles = _mm_and_si128( _mm_srli_epi32( dest, 4 ), _mm_set1_epi32( 0x000F0F0F ) );
+	__m128i blended = _mm_or_si128( _mm_add_epi32( src, _mm_mullo_epi16( destNibbles, multiplier ) ), _mm_set1_epi32( static_cast<int>( 0xFF000000 ) ) );
+
+	// Fully transparent source pixels leave the destination untouched
+	__m128i transparent = _mm_cmpeq_epi32( _mm_srli_epi32( src, 24 ), _mm_set1_epi32( 0xFF ) );
+	__m128i result = _mm_or_si128( _mm_and_si128( transparent, dest ), _mm_andnot_si128( transparent, blended ) );
+
+	_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest ), result );
+}
+
+// Blends 8 pre-multiplied pixels into the destination (AVX2 version of BlendPreMultiplied4)
+PLAY_TARGET_AVX2 static inline void BlendPreMultiplied8( uint32_t* pDest, const uint32_t* pSrc )
+{
+	__m256i src = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pSrc ) );
+	__m256i dest = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pDest ) );
+
+	__m256i invAlpha = _mm256_srli_epi32( src, 28 );
+	__m256i multiplier = _mm256_or_si256( invAlpha, _mm256_slli_epi32( invAlpha, 16 ) );
+	__m256i destNibbles = _mm256_and_si256( _mm256_srli_epi32( dest, 4 ), _mm256_set1_epi32( 0x000F0F0F ) );
+	__m256i blended = _mm256_or_si256( _mm256_add_epi32( src, _mm256_mullo_epi16( destNibbles, multiplier ) ), _mm256_set1_epi32( static_cast<int>( 0xFF000000 ) ) );
+
+	__m256i transparent = _mm256_cmpeq_epi32( _mm256_srli_epi32( src, 24 ), _mm256_set1_epi32( 0xFF ) );
+	__m256i result = _mm256_blendv_epi8( blended, dest, transparent );
+
+	_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDest ), result );
+}
+
+// Skips and blends the row 8 pixels at a time until fewer than 8 are left, and returns the number of pixels it got through
+// > Keeping the whole loop inside the AVX2 function lets BlendPreMultiplied8 be inlined into it
+PLAY_TARGET_AVX2 static int BlendPreMultipliedRow8( uint32_t* pDest, const uint32_t* pSrc, int width )
+{
+	int x = 0;
+
+	while( x + 8 <= width )
+	{
+		uint32_t src = pSrc[x];
+
+		if( src >= 0xFF000000 )
+		{
+			uint32_t skip = static_cast<uint32_t>( width - x ) - 1;
+			src = src & 0x00FFFFFF;
+			if( skip > src ) skip = src;
+
+			x += skip + 1;
+			continue;
+		}
+
+		BlendPreMultiplied8( pDest + x, pSrc + x );
+		x += 8;
+	}
+
+	return x;
+}
+
+#endif
+
+//********************************************************************************************************************************
+// Function:	BlendPreMultipliedRow - blends a row of pre-multiplied pixels into the destination
+// Parameters:	pDest = the first destination pixel in the row
+//				pSrc = the first pre-multiplied source pixel in the row (from PreMultiplyAlpha)
+//				width = the number of pixels in the row
+// Notes:		Runs of fully-transparent pixels are skipped using the counts stored by PreMultiplyAlpha. Everything else is
+//				blended 8 or 4 pixels at a time when the CPU allows, giving bit-identical results to the scalar version.
+//********************************************************************************************************************************
+void PlayBlitter::BlendPreMultipliedRow( uint32_t* pDest, const uint32_t* pSrc, int width )
+{
+	const SimdLevel simdLevel = s_simdLevel;
+	int x = 0;
+
+#ifdef PLAY_SIMD
+	if( simdLevel == SIMD_AVX2 )
+		x = BlendPreMultipliedRow8( pDest, pSrc, width );
+#endif
+
+	while( x < width )
+	{
+		uint32_t src = pSrc[x];
+
+		// If this is a fully transparent pixel then the low bits store how many there are in a row
+		// This means we can skip to the next pixel which isn't fully transparent
+		if( src >= 0xFF000000 )
+		{
+			uint32_t skip = static_cast<uint32_t>( width - x ) - 1;
+			src = src & 0x00FFFFFF;
+			if( skip > src ) skip = src;
+
+			x += skip + 1;
+			continue;
+		}
+
+#ifdef PLAY_SIMD
+		if( simdLevel != SIMD_NONE && x + 4 <= width )
+		{
+			BlendPreMultiplied4( pDest + x, pSrc + x );
+			x += 4;
+			continue;
+		}
+#endif
+
+		// This performes the dest*(1-srcAlpha) calculation for all channels in parallel with minor accuracy loss in dest colour.
+		// It does this by shifting all the destination channels down by 4 bits in order to "make room" for the later multiplication.
+		// After shifting down, it masks out the bits which have shifted into the adjacent channel data.
+		// This causes the RGB data to be rounded down to their nearest 16 producing a reduction in colour accuracy.
+		// This is then multiplied by the inverse alpha (inversed in PreMultiplyAlpha), also divided by 16 (hence >> 8+8+8+4).
+		// The multiplication brings our RGB values back up to their original bit ranges (albeit rounded to the nearest 16).
+		// As the colour accuracy only affects the destination pixels behind semi-transparent source pixels and so isn't very obvious.
+		uint32_t dest = ( ( ( pDest[x] >> 4 ) & 0x000F0F0F ) * ( src >> 28 ) );
+		// Add the (pre-multiplied Alpha) source to the destination and force alpha to opaque
+		pDest[x] = ( src + dest ) | 0xFF000000;
+		x++;
+	}
+
+#ifndef PLAY_SIMD
+	UNREFERENCED_PARAMETER( simdLevel );
+#endif
+}
+
+#ifdef PLAY_SIMD
+
+// Blends 4 pre-multiplied pixels into the destination with a separate multiply for each channel and a global alpha
+// > Each channel sits in its own 32-bit lane, and with alphaMultiply <= 1 the products fit in 16 bits, so a 16-bit multiply is exact
+static inline void BlendMultiplied4( uint32_t* pDest, const uint32_t* pSrc, __m128 alphaMultiply, __m128i constAlpha )
+{
+	const __m128i channelMask = _mm_set1_epi32( 0xFF );
+	__m128i src = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc ) );
+	__m128i dest = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pDest ) );
+
+	// int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
+	__m128i srcAlpha = _mm_cvttps_epi32( _mm_mul_ps( _mm_cvtepi32_ps( _mm_sub_epi32( channelMask, _mm_srli_epi32( src, 24 ) ) ), alphaMultiply ) );
+	__m128i invSrcAlpha = _mm_sub_epi32( channelMask, srcAlpha );
+
+	__m128i red = _mm_add_epi32( _mm_mullo_epi16( constAlpha, _mm_and_si128( _mm_srli_epi32( src, 16 ), channelMask ) ),
+								 _mm_mullo_epi16( invSrcAlpha, _mm_and_si128( _mm_srli_epi32( dest, 16 ), channelMask ) ) );
+	__m128i green = _mm_add_epi32( _mm_mullo_epi16( constAlpha, _mm_and_si128( _mm_srli_epi32( src, 8 ), channelMask ) ),
+								   _mm_mullo_epi16( invSrcAlpha, _mm_and_si128( _mm_srli_epi32( dest, 8 ), channelMask ) ) );
+	__m128i blue = _mm_add_epi32( _mm_mullo_epi16( constAlpha, _mm_and_si128( src, channelMask ) ),
+								  _mm_mullo_epi16( invSrcAlpha, _mm_and_si128( dest, channelMask ) ) );
+
+	// Bring back to the range 0-255 and put the ARGB components back together again
+	__m128i blended = _mm_or_si128( _mm_set1_epi32( static_cast<int>( 0xFF000000 ) ), _mm_slli_epi32( _mm_srli_epi32( red, 8 ), 16 ) );
+	blended = _mm_or_si128( blended, _mm_slli_epi32( _mm_srli_epi32( green, 8 ), 8 ) );
+	blended = _mm_or_si128( blended, _mm_srli_epi32( blue, 8 ) );
+
+	// Fully transparent source pixels leave the destination untouched
+	__m128i transparent = _mm_cmpeq_epi32( _mm_srli_epi32( src, 24 ), channelMask );
+	__m128i result = _mm_or_si128( _mm_and_si128( transparent, dest ), _mm_andnot_si128( transparent, blended ) );
+
+	_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest ), result );
+}
+
+// Blends 8 pre-multiplied pixels into the destination with a global alpha (AVX2 version of BlendMultiplied4)
+PLAY_TARGET_AVX2 static inline void BlendMultiplied8( uint32_t* pDest, const uint32_t* pSrc, __m256 alphaMultiply, __m256i constAlpha )
+{
+	const __m256i channelMask = _mm256_set1_epi32( 0xFF );
+	__m256i src = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pSrc ) );
+	__m256i dest = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pDest ) );
+
+	__m256i srcAlpha = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_sub_epi32( channelMask, _mm256_srli_epi32( src, 24 ) ) ), alphaMultiply ) );
+	__m256i invSrcAlpha = _mm256_sub_epi32( channelMask, srcAlpha );
+
+	__m256i red = _mm256_add_epi32( _mm256_mullo_epi16( constAlpha, _mm256_and_si256( _mm256_srli_epi32( src, 16 ), channelMask ) ),
+									_mm256_mullo_epi16( invSrcAlpha, _mm256_and_si256( _mm256_srli_epi32( dest, 16 ), channelMask ) ) );
+	__m256i green = _mm256_add_epi32( _mm256_mullo_epi16( constAlpha, _mm256_and_si256( _mm256_srli_epi32( src, 8 ), channelMask ) ),
+									  _mm256_mullo_epi16( invSrcAlpha, _mm256_and_si256( _mm256_srli_epi32( dest, 8 ), channelMask ) ) );
+	__m256i blue = _mm256_add_epi32( _mm256_mullo_epi16( constAlpha, _mm256_and_si256( src, channelMask ) ),
+									 _mm256_mullo_epi16( invSrcAlpha, _mm256_and_si256( dest, channelMask ) ) );
+
+	__m256i blended = _mm256_or_si256( _mm256_set1_epi32( static_cast<int>( 0xFF000000 ) ), _mm256_slli_epi32( _mm256_srli_epi32( red, 8 ), 16 ) );
+	blended = _mm256_or_si256( blended, _mm256_slli_epi32( _mm256_srli_epi32( green, 8 ), 8 ) );
+	blended = _mm256_or_si256( blended, _mm256_srli_epi32( blue, 8 ) );
+
+	__m256i transparent = _mm256_cmpeq_epi32( _mm256_srli_epi32( src, 24 ), channelMask );
+	__m256i result = _mm256_blendv_epi8( blended, dest, transparent );
+
+	_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDest ), result );
+}
+
+// Blends as many whole groups of 8 pixels as fit in the row and returns the number of pixels blended
+PLAY_TARGET_AVX2 static int BlendMultipliedRow8( uint32_t* pDest, const uint32_t* pSrc, int width, float alphaMultiply, int constAlpha )
+{
+	const __m256 alphaMultiply8 = _mm256_set1_ps( alphaMultiply );
+	const __m256i constAlpha8 = _mm256_set1_epi32( constAlpha );
+	int x = 0;
+	for( ; x + 8 <= width; x += 8 )
+		BlendMultiplied8( pDest + x, pSrc + x, alphaMultiply8, constAlpha8 );
+	return x;
+}
+
+#endif
+
+//********************************************************************************************************************************
+// Function:	TintRow - multiplies the colour channels of a row of pre-multiplied pixels by a tint colour
+// Parameters:	pDest = the first pixel to write the tinted row to (which can be the same as pSrc)
+//				pSrc = the first pre-multiplied source pixel in the row
+//				width = the number of pixels in the row
+//				tint = the colour to multiply by (white leaves the pixels unchanged)
+// Notes:		Multiplying pre-multiplied channels by the tint is the same as tinting before pre-multiplying, which is what
+//				ColourSprite does. Fully-transparent pixels are copied as they are, as they hold skip counts.
+//********************************************************************************************************************************
+void PlayBlitter::TintRow( uint32_t* pDest, const uint32_t* pSrc, int width, Pixel tint )
+{
+	// Scale the tint channels to 0-256 so that 255 leaves a channel unchanged
+	const uint32_t tintRed = tint.r + ( tint.r >> 7 );
+	const uint32_t tintGreen = tint.g + ( tint.g >> 7 );
+	const uint32_t tintBlue = tint.b + ( tint.b >> 7 );
+
+	for( int x = 0; x < width; x++ )
+	{
+		uint32_t src = pSrc[x];
+
+		if( src >= 0xFF000000 )
+		{
+			pDest[x] = src;
+			continue;
+		}
+
+		uint32_t red = ( ( ( src >> 16 ) & 0xFF ) * tintRed ) >> 8;
+		uint32_t green = ( ( ( src >> 8 ) & 0xFF ) * tintGreen ) >> 8;
+		uint32_t blue = ( ( src & 0xFF ) * tintBlue ) >> 8;
+		pDest[x] = ( src & 0xFF000000 ) | ( red << 16 ) | ( green << 8 ) | blue;
+	}
+}
+
+//********************************************************************************************************************************
+// Function:	BlendMultipliedRow - blends a row of pre-multiplied pixels into the destination with a global alpha multiply
+// Parameters:	pDest = the first destination pixel in the row
+//				pSrc = the first pre-multiplied source pixel in the row
+//				width = the number of pixels in the row
+//				alphaMultiply = the global alpha (0.0f - 1.0f)
+// Notes:		Performs a 'typical' alpha blend on each channel separately: (src * srcAlpha)+(dest * (1-srcAlpha)).
+//				The source doesn't need to be contiguous image data (skip counts are ignored), so it also suits gathered pixels.
+//********************************************************************************************************************************
+void PlayBlitter::BlendMultipliedRow( uint32_t* pDest, const uint32_t* pSrc, int width, float alphaMultiply )
+{
+	const SimdLevel simdLevel = s_simdLevel;
+	const int constAlpha = static_cast<int>( 255 * alphaMultiply );
+	int x = 0;
+
+#ifdef PLAY_SIMD
+	if( simdLevel == SIMD_AVX2 )
+		x = BlendMultipliedRow8( pDest, pSrc, width, alphaMultiply, constAlpha );
+
+	if( simdLevel != SIMD_NONE )
+	{
+		const __m128 alphaMultiply4 = _mm_set1_ps( alphaMultiply );
+		const __m128i constAlpha4 = _mm_set1_epi32( constAlpha );
+		for( ; x + 4 <= width; x += 4 )
+			BlendMultiplied4( pDest + x, pSrc + x, alphaMultiply4, constAlpha4 );
+	}
+#else
+	UNREFERENCED_PARAMETER( simdLevel );
+#endif
+
+	for( ; x < width; x++ )
+	{
+		uint32_t src = pSrc[x];
+
+		// Fully transparent pixels leave the destination untouched
+		if( src >= 0xFF000000 )
+			continue;
+
+		int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
+
+		// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
+		int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
+		int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
+		int destBlue = constAlpha * ( src & 0xFF );
+
+		uint32_t dest = pDest[x];
+		int invSrcAlpha = 0xFF - srcAlpha;
+
+		// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
+		destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
+		destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
+		destBlue += invSrcAlpha * ( dest & 0xFF );
+
+		// Bring back to the range 0-255
+		destRed >>= 8;
+		destGreen >>= 8;
+		destBlue >>= 8;
+
+		// Put ARGB components back together again
+		pDest[x] = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
+	}
+}
+
+void PlayBlitter::CopyOpaqueRow( uint32_t* pDest, const uint32_t* pSrc, int width )
+{
+	// Opaque pre-multiplied pixels have an inverted alpha of 0, so blending them is just forcing the alpha back to opaque
+	for( int x = 0; x < width; x++ )
+		pDest[x] = pSrc[x] | 0xFF000000;
+}
+
+#ifdef PLAY_SIMD
+
+// Adds 4 pre-multiplied pixels scaled by a global alpha (0-256) to the destination, saturating each channel
+// > The channels are widened to 16 bits for the multiply, and 255 * 256 still fits, so the result matches the scalar version
+static inline void AddMultiplied4( uint32_t* pDest, const uint32_t* pSrc, __m128i constAlpha )
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i src = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pSrc ) );
+	__m128i dest = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pDest ) );
+
+	__m128i colour = _mm_and_si128( src, _mm_set1_epi32( 0x00FFFFFF ) );
+	__m128i low = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( colour, zero ), constAlpha ), 8 );
+	__m128i high = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( colour, zero ), constAlpha ), 8 );
+	__m128i added = _mm_or_si128( _mm_adds_epu8( dest, _mm_packus_epi16( low, high ) ), _mm_set1_epi32( static_cast<int>( 0xFF000000 ) ) );
+
+	// Fully transparent source pixels leave the destination untouched
+	__m128i transparent = _mm_cmpeq_epi32( _mm_srli_epi32( src, 24 ), _mm_set1_epi32( 0xFF ) );
+	__m128i result = _mm_or_si128( _mm_and_si128( transparent, dest ), _mm_andnot_si128( transparent, added ) );
+
+	_mm_storeu_si128( reinterpret_cast<__m128i*>( pDest ), result );
+}
+
+// Adds as many whole groups of 8 pixels as fit in the row and returns the number of pixels added (AVX2 version of AddMultiplied4)
+PLAY_TARGET_AVX2 static int AddMultipliedRow8( uint32_t* pDest, const uint32_t* pSrc, int width, int constAlpha )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i constAlpha8 = _mm256_set1_epi16( static_cast<short>( constAlpha ) );
+	const __m256i colourMask = _mm256_set1_epi32( 0x00FFFFFF );
+	const __m256i alphaMask = _mm256_set1_epi32( static_cast<int>( 0xFF000000 ) );
+	const __m256i channelMask = _mm256_set1_epi32( 0xFF );
+	int x = 0;
+
+	for( ; x + 8 <= width; x += 8 )
+	{
+		__m256i src = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pSrc + x ) );
+		__m256i dest = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( pDest + x ) );
+
+		// The unpacks and the pack both work within each 128-bit lane, so the pixels come back out in their original order
+		__m256i colour = _mm256_and_si256( src, colourMask );
+		__m256i low = _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_unpacklo_epi8( colour, zero ), constAlpha8 ), 8 );
+		__m256i high = _mm256_srli_epi16( _mm256_mullo_epi16( _mm256_unpackhi_epi8( colour, zero ), constAlpha8 ), 8 );
+		__m256i added = _mm256_or_si256( _mm256_adds_epu8( dest, _mm256_packus_epi16( low, high ) ), alphaMask );
+
+		__m256i transparent = _mm256_cmpeq_epi32( _mm256_srli_epi32( src, 24 ), channelMask );
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>( pDest + x ), _mm256_blendv_epi8( added, dest, transparent ) );
+	}
+
+	return x;
+}
+
+#endif
+
+//********************************************************************************************************************************
+// Function:	AddMultipliedRow - adds a row of pre-multiplied pixels to the destination with a global alpha multiply
+// Parameters:	pDest = the first destination pixel in the row
+//				pSrc = the first pre-multiplied source pixel in the row
+//				width = the number of pixels in the row
+//				alphaMultiply = the global alpha (0.0f - 1.0f)
+// Notes:		Performs an additive blend on each channel separately: dest + (src * srcAlpha), clamped to 255. The source is
+//				already multiplied by its own alpha, so only the global alpha is applied. Skip counts are ignored, as with
+//				BlendMultipliedRow, so this suits gathered pixels too.
+//********************************************************************************************************************************
+void PlayBlitter::AddMultipliedRow( uint32_t* pDest, const uint32_t* pSrc, int width, float alphaMultiply )
+{
+	const SimdLevel simdLevel = s_simdLevel;
+	// Scaled to 0-256 so that an alpha of 1 adds the source channels unchanged
+	const uint32_t constAlpha = static_cast<uint32_t>( 256 * std::max( 0.0f, std::min( alphaMultiply, 1.0f ) ) );
+	int x = 0;
+
+#ifdef PLAY_SIMD
+	if( simdLevel == SIMD_AVX2 )
+		x = AddMultipliedRow8( pDest, pSrc, width, constAlpha );
+
+	if( simdLevel != SIMD_NONE )
+	{
+		const __m128i constAlpha4 = _mm_set1_epi16( static_cast<short>( constAlpha ) );
+		for( ; x + 4 <= width; x += 4 )
+			AddMultiplied4( pDest + x, pSrc + x, constAlpha4 );
+	}
+#else
+	UNREFERENCED_PARAMETER( simdLevel );
+#endif
+
+	for( ; x < width; x++ )
+	{
+		uint32_t src = pSrc[x];
+
+		// Fully transparent pixels leave the destination untouched
+		if( src >= 0xFF000000 )
+			continue;
+
+		uint32_t dest = pDest[x];
+		uint32_t red = std::min( ( ( dest >> 16 ) & 0xFF ) + ( ( ( ( src >> 16 ) & 0xFF ) * constAlpha ) >> 8 ), 0xFFu );
+		uint32_t green = std::min( ( ( dest >> 8 ) & 0xFF ) + ( ( ( ( src >> 8 ) & 0xFF ) * constAlpha ) >> 8 ), 0xFFu );
+		uint32_t blue = std::min( ( dest & 0xFF ) + ( ( ( src & 0xFF ) * constAlpha ) >> 8 ), 0xFFu );
+
+		pDest[x] = 0xFF000000 | ( red << 16 ) | ( green << 8 ) | blue;
+	}
+}
+
+//********************************************************************************************************************************
+// Function:	ClipFixedPointSpan - narrows [spanStart, spanEnd) to the steps i where 0 < start + i*step < limit
+// Parameters:	start, step and limit are all in 16.16 fixed point
+//********************************************************************************************************************************
+void PlayBlitter::ClipFixedPointSpan( long long start, int step, long long limit, int& spanStart, int& spanEnd )
+{
+	// Floor division for a positive divisor
+	auto floorDiv = []( long long a, long long b ) { return a >= 0 ? a / b : -( ( -a + b - 1 ) / b ); };
+
+	long long first = spanStart;
+	long long last = spanEnd;
+
+	if( step > 0 )
+	{
+		first = std::max( first, floorDiv( -start, step ) + 1 );	// start + i*step > 0
+		last = std::min( last, -floorDiv( start - limit, step ) );	// start + i*step < limit
+	}
+	else if( step < 0 )
+	{
+		first = std::max( first, floorDiv( start - limit, -step ) + 1 );
+		last = std::min( last, -floorDiv( -start, -step ) );
+	}
+	else if( start <= 0 || start >= limit )
+	{
+		last = first; // Never inside the sprite
+	}
+
+	spanStart = static_cast<int>( first );
+	spanEnd = static_cast<int>( std::max( first, last ) );
+}
+
+//********************************************************************************************************************************
+// Function:	BlitPixels - draws image data with and without a global alpha multiply
+// Parameters:	spriteId = the id of the sprite to draw
+//				xpos, ypos = the position you want to draw the sprite
+//				frameIndex = which frame of the animation to draw (wrapped)
+// Notes:		Alpha multiply approach is relatively unoptimized
+//********************************************************************************************************************************
+void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply ) const
+{
+	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
+
+	// Nothing within the clipping rectangle to draw
+	if( blitX >= m_clipRight || blitX + blitWidth <= m_clipLeft || blitY >= m_clipBottom || blitY + blitHeight <= m_clipTop )
+		return;
+
+	// Work out if we need to clip to the clipping rectangle (and by how much)
+	int xClipStart = m_clipLeft - blitX;
+	if( xClipStart < 0 ) { xClipStart = 0; }
+
+	int xClipEnd = ( blitX + blitWidth ) - m_clipRight;
+	if( xClipEnd < 0 ) { xClipEnd = 0; }
+
+	int yClipStart = m_clipTop - blitY;
+	if( yClipStart < 0 ) { yClipStart = 0; }
+
+	int yClipEnd = ( blitY + blitHeight ) - m_clipBottom;
+	if( yClipEnd < 0 ) { yClipEnd = 0; }
+
+	// Set up the source and destination pointers based on clipping
+	int destOffset = ( m_pRenderTarget->width * ( blitY + yClipStart ) ) + ( blitX + xClipStart );
+	uint32_t* destPixels = &m_pRenderTarget->pPixels->bits + destOffset;
+
+	int srcClipOffset = ( srcPixelData.width * yClipStart ) + xClipStart;
+	uint32_t* srcPixels = &srcPixelData.pPixels->bits + srcOffset + srcClipOffset;
+
+	// Work out in advance how much we need to add to src and dest to reach the next row 
+	int destInc = m_pRenderTarget->width - blitWidth + xClipEnd + xClipStart;
+	int srcInc = srcPixelData.width - blitWidth + xClipEnd + xClipStart;
+
+	//Work out final pixel in destination.
+	int destColOffset = ( m_pRenderTarget->width * ( blitHeight - yClipEnd - yClipStart - 1 ) ) + ( blitWidth - xClipEnd - xClipStart );
+	uint32_t* destColEnd = destPixels + destColOffset;
+
+	//How many pixels per row in sprite.
 	int endRow = blitWidth - xClipEnd - xClipStart;
 
 	if( alphaMultiply < 1.0f )
@@ -2028,50 +3973,168 @@ void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, int
 		// blending operation (src * srcAlpha)+(dest * (1-srcAlpha)). Not easy to apply a global alpha multiplication over the top, but used everywhere else.
 		// *******************************************************************************************************************************************************
 
-		// Slightly more optimised iterations without the additions in the loop
+		// Each row is handled by the fastest kernel the CPU supports (see BlendPreMultipliedRow)
 		while( destPixels < destColEnd )
 		{
-			uint32_t* destRowEnd = destPixels + endRow;
+			BlendPreMultipliedRow( destPixels, srcPixels, endRow );
 
-			while( destPixels < destRowEnd )
+			// Increase buffers by pre-calculated amounts
+			destPixels += endRow + destInc;
+			srcPixels += endRow + srcInc;
+		}
+
+	}
+
+	return;
+}
+
+//********************************************************************************************************************************
+// Function:	BlitPixels - draws pre-multiplied image data using its span list
+// Parameters:	srcPixelData = the pre-multiplied pixel data containing the image
+//				srcOffset = the offset of the image's top left pixel within the pixel data
+//				spanList = the image's spans (from BuildSpanList)
+//				blitX, blitY = the position of the image's top left pixel on the render target
+//				blitWidth, blitHeight = the size of the image
+//				alphaMultiply = the global alpha (0.0f - 1.0f)
+// Notes:		Each span is clipped to the render target and then copied (opaque) or blended (translucent). Gaps between the
+//				spans are fully transparent and are skipped without reading them.
+//********************************************************************************************************************************
+void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, const SpanList& spanList, int blitX, int blitY, int blitWidth, int blitHeight, float alphaMultiply, Pixel tint, BlendMode blendMode ) const
+{
+	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
+	PLAY_ASSERT_MSG( spanList.rowStart.size() == static_cast<size_t>( blitHeight ) + 1, "Span list doesn't match the image being drawn" );
+
+	// The part of the image which lies within the clipping rectangle
+	int clipLeft = std::max( 0, m_clipLeft - blitX );
+	int clipRight = std::min( blitWidth, m_clipRight - blitX );
+	int clipTop = std::max( 0, m_clipTop - blitY );
+	int clipBottom = std::min( blitHeight, m_clipBottom - blitY );
+
+	// Nothing within the clipping rectangle to draw
+	if( clipLeft >= clipRight || clipTop >= clipBottom )
+		return;
+
+	// A negative alpha would make the blended channels overflow into each other
+	alphaMultiply = std::max( alphaMultiply, 0.0f );
+
+	const PixelSpan* pSpans = spanList.spans.data();
+
+	auto drawSpan = [alphaMultiply, blendMode]( uint32_t* pDest, const uint32_t* pSrc, int count, bool opaque )
+	{
+		if( blendMode == BLEND_ADDITIVE )
+			AddMultipliedRow( pDest, pSrc, count, alphaMultiply );
+		else if( alphaMultiply < 1.0f )
+			BlendMultipliedRow( pDest, pSrc, count, alphaMultiply );
+		else if( opaque )
+			CopyOpaqueRow( pDest, pSrc, count );
+		else
+			BlendPreMultipliedRow( pDest, pSrc, count );
+	};
+
+	// Tinted spans are drawn in batches from a copy which has been tinted
+	constexpr int TINT_BATCH = 64;
+	uint32_t tintedPixels[TINT_BATCH];
+	const bool tinted = IsTinted( tint );
+
+	for( int y = clipTop; y < clipBottom; y++ )
+	{
+		uint32_t* destRow = &m_pRenderTarget->pPixels->bits + ( static_cast<ptrdiff_t>( m_pRenderTarget->width ) * ( blitY + y ) ) + blitX;
+		const uint32_t* srcRow = &srcPixelData.pPixels->bits + srcOffset + ( static_cast<ptrdiff_t>( srcPixelData.width ) * y );
+
+		for( int i = spanList.rowStart[y]; i < spanList.rowStart[y + 1]; i++ )
+		{
+			int start = std::max( static_cast<int>( pSpans[i].start ), clipLeft );
+			int end = std::min( pSpans[i].start + pSpans[i].length, clipRight );
+
+			if( start >= end )
+				continue;
+
+			if( !tinted )
 			{
-				uint32_t src = *srcPixels++;
-				uint32_t dest = *destPixels;
+				drawSpan( destRow + start, srcRow + start, end - start, pSpans[i].opaque );
+				continue;
+			}
 
-				// If this isn't a fully transparent pixel 
-				if( src < 0xFF000000 )
-				{
-					// This performes the dest*(1-srcAlpha) calculation for all channels in parallel with minor accuracy loss in dest colour.
-					// It does this by shifting all the destination channels down by 4 bits in order to "make room" for the later multiplication.
-					// After shifting down, it masks out the bits which have shifted into the adjacent channel data.
-					// This causes the RGB data to be rounded down to their nearest 16 producing a reduction in colour accuracy.
-					// This is then multiplied by the inverse alpha (inversed in PreMultiplyAlpha), also divided by 16 (hence >> 8+8+8+4).
-					// The multiplication brings our RGB values back up to their original bit ranges (albeit rounded to the nearest 16).
-					// As the colour accuracy only affects the destination pixels behind semi-transparent source pixels and so isn't very obvious.
-					dest = ( ( ( dest >> 4 ) & 0x000F0F0F ) * ( src >> 28 ) );
-					// Add the (pre-multiplied Alpha) source to the destination and force alpha to opaque
-					*destPixels++ = ( src + dest ) | 0xFF000000;
-				}
-				else
+			// Tinting doesn't change the alpha, so the tinted pixels can be drawn just like the span's own
+			for( int x = start; x < end; x += TINT_BATCH )
+			{
+				int count = std::min( end - x, TINT_BATCH );
+				TintRow( tintedPixels, srcRow + x, count, tint );
+				drawSpan( destRow + x, tintedPixels, count, pSpans[i].opaque );
+			}
+		}
+	}
+}
+
+//********************************************************************************************************************************
+// Function:	BuildSpanList - finds the runs of visible pixels in each row of a block of pre-multiplied pixel data
+// Parameters:	srcPixelData = the pre-multiplied pixel data containing the image
+//				srcOffset = the offset of the image's top left pixel within the pixel data
+//				width, height = the size of the image
+//				spanList = receives the spans
+// Notes:		Short runs of opaque pixels are merged into the translucent spans around them, as switching between copying and
+//				blending costs more than it saves for just a few pixels.
+//********************************************************************************************************************************
+void PlayBlitter::BuildSpanList( const PixelData& srcPixelData, int srcOffset, int width, int height, SpanList& spanList )
+{
+	PLAY_ASSERT_MSG( width <= 0xFFFF, "Image is too wide for a span list" );
+
+	constexpr int MIN_OPAQUE_SPAN = 8;
+
+	spanList.spans.clear();
+	spanList.rowStart.resize( static_cast<size_t>( height ) + 1 );
+
+	auto addSpan = [&spanList]( int start, int end, bool opaque )
+	{
+		PixelSpan span;
+		span.start = static_cast<uint16_t>( start );
+		span.length = static_cast<uint16_t>( end - start );
+		span.opaque = opaque;
+		spanList.spans.push_back( span );
+	};
+
+	for( int y = 0; y < height; y++ )
+	{
+		const uint32_t* srcRow = &srcPixelData.pPixels->bits + srcOffset + ( static_cast<ptrdiff_t>( srcPixelData.width ) * y );
+		spanList.rowStart[y] = static_cast<int>( spanList.spans.size() );
+
+		int x = 0;
+		while( x < width )
+		{
+			// Fully transparent pixels (inverted alpha of 0xFF) aren't part of any span
+			if( srcRow[x] >= 0xFF000000 )
+			{
+				x++;
+				continue;
+			}
+
+			// Split the run of visible pixels into opaque spans (inverted alpha of 0) and the translucent ones between them
+			int translucentStart = x;
+			while( x < width && srcRow[x] < 0xFF000000 )
+			{
+				int opaqueStart = x;
+				while( x < width && srcRow[x] < 0x01000000 )
+					x++;
+
+				if( x - opaqueStart >= MIN_OPAQUE_SPAN )
 				{
-					// If this is a fully transparent pixel then the low bits store how many there are in a row
-					// This means we can skip to the next pixel which isn't fully transparent
-					uint32_t skip = static_cast<uint32_t>( destRowEnd - destPixels ) - 1;
-					src = src & 0x00FFFFFF;
-					if( skip > src ) skip = src;
+					if( opaqueStart > translucentStart )
+						addSpan( translucentStart, opaqueStart, false );
 
-					srcPixels += skip;
-					++destPixels += skip;
+					addSpan( opaqueStart, x, true );
+					translucentStart = x;
 				}
+
+				if( x == opaqueStart )
+					x++;
 			}
-			// Increase buffers by pre-calculated amounts
-			destPixels += destInc;
-			srcPixels += srcInc;
-		}
 
+			if( x > translucentStart )
+				addSpan( translucentStart, x, false );
+		}
 	}
 
-	return;
+	spanList.rowStart[height] = static_cast<int>( spanList.spans.size() );
 }
 
 //********************************************************************************************************************************
@@ -2083,13 +4146,17 @@ void PlayBlitter::BlitPixels( const PixelData& srcPixelData, int srcOffset, int
 //				scale = parameter to magnify the sprite.
 //				rotOffX, rotOffY = offset of centre of rotation to the top left of the sprite
 //				alpha = the fraction defining the amount of sprite and background that is draw. 255 = all sprite, 0 = all background.
-// Notes:		Pre-calculates roughly where the sprite will be in the display buffer and only processes those pixels. 
-//				Approx 15 times slower than not rotating.
+// Notes:		Pre-calculates roughly where the sprite will be in the display buffer, then steps through the sprite in 16.16 
+//				fixed point. The span of each row which lands inside the sprite is calculated up front, so there are no per-pixel
+//				bounds checks, and the pixels are blended in batches by BlendMultipliedRow.
 //********************************************************************************************************************************
-void PlayBlitter::RotateScalePixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, int originX, int originY, float angle, float scale, float alphaMultiply ) const
+void PlayBlitter::RotateScalePixels( const PixelData& srcPixelData, int srcOffset, int blitX, int blitY, int blitWidth, int blitHeight, int originX, int originY, float angle, float scale, float alphaMultiply, Pixel tint, BlendMode blendMode ) const
 {
 	PLAY_ASSERT_MSG( m_pRenderTarget, "Render target not set for PlayBlitter" );
 
+	// Opacity above 1 would make the blended channels overflow into each other
+	alphaMultiply = std::max( 0.0f, std::min( alphaMultiply, 1.0f ) );
+
 	//pointers to start of source and destination buffers
 	uint32_t* pSrcBase = &srcPixelData.pPixels->bits + srcOffset;
 	uint32_t* pDstBase = &m_pRenderTarget->pPixels->bits;
@@ -2134,102 +4201,107 @@ void PlayBlitter::RotateScalePixels( const PixelData& srcPixelData, int srcOffse
 		maxY = std::max( maxY, boundingBoxCorners[i][1] );
 	}
 
-	//clip the starting and finishing positions.
-	int startY = blitY + static_cast<int>( minY );
-	if( startY < 0 ) { startY = 0; minY = static_cast<float>( -blitY ); }
-
-	int endY = blitY + static_cast<int>( maxY );
-	if( endY > m_pRenderTarget->height ) { endY = m_pRenderTarget->height; }
+	//clip the starting and finishing positions (rounding outwards so partly covered pixels at the edges aren't lost).
+	int startY = blitY + static_cast<int>( floorf( minY ) );
+	if( startY < m_clipTop ) { startY = m_clipTop; }
 
-	int startX = blitX + static_cast<int>( minX );
-	if( startX < 0 ) { startX = 0; minX = static_cast<float>( -blitX ); }
+	int endY = blitY + static_cast<int>( ceilf( maxY ) );
+	if( endY > m_clipBottom ) { endY = m_clipBottom; }
 
-	int endX = blitX + static_cast<int>( maxX );
-	if( endX > m_pRenderTarget->width ) { endX = m_pRenderTarget->width; }
+	int startX = blitX + static_cast<int>( floorf( minX ) );
+	if( startX < m_clipLeft ) { startX = m_clipLeft; }
 
-	//rotate the basis so we get the edge of the bounding box in the sprite frame.
-	float startingU = dUdX * minX + dUdY * minY + fRotCentreU;
-	float startingV = dVdY * minY + dVdX * minX + fRotCentreV;
+	int endX = blitX + static_cast<int>( ceilf( maxX ) );
+	if( endX > m_clipRight ) { endX = m_clipRight; }
 
-	float rowU = startingU;
-	float rowV = startingV;
+	// Change in u/v for a unit change in x/y in 16.16 fixed point, and the sprite limits in the same units
+	const int dUdXFixed = static_cast<int>( dUdX * 65536.0f );
+	const int dVdXFixed = static_cast<int>( dVdX * 65536.0f );
+	const int dUdYFixed = static_cast<int>( dUdY * 65536.0f );
+	const int dVdYFixed = static_cast<int>( dVdY * 65536.0f );
+	const long long widthFixed = static_cast<long long>( blitWidth ) << 16;
+	const long long heightFixed = static_cast<long long>( blitHeight ) << 16;
+	const int rowLength = endX - startX;
 
-	uint32_t* destPixels = pDstBase + ( static_cast<size_t>( m_pRenderTarget->width ) * startY ) + startX;
-	int nextRow = m_pRenderTarget->width - ( endX - startX );
+	uint32_t* destRow = pDstBase + ( static_cast<size_t>( m_pRenderTarget->width ) * startY ) + startX;
 
-	uint32_t* srcPixels = pSrcBase;
+	// Source pixels are gathered along the span in batches and then blended together
+	constexpr int GATHER_SIZE = 64;
+	uint32_t gathered[GATHER_SIZE];
+	const bool tinted = IsTinted( tint );
 
-	//Start of double for loop. 
-	for( int y = startY; y < endY; y++ )
+	for( int y = startY; y < endY && rowLength > 0; y++ )
 	{
-		float u = rowU;
-		float v = rowV;
-
-		for( int x = startX; x < endX; x++ )
-		{
-			//Check to see if u and v correspond to a valid pixel in sprite.
-			if( u > 0 && v > 0 && u < blitWidth && v < blitHeight )
-			{
-				srcPixels = pSrcBase + static_cast<size_t>( u ) + ( static_cast<size_t>( v ) * srcPixelData.width );
-				uint32_t src = *srcPixels;
-
-				if( src < 0xFF000000 )
-				{
-					int srcAlpha = static_cast<int>( ( 0xFF - ( src >> 24 ) ) * alphaMultiply );
-					int constAlpha = static_cast<int>( 255 * alphaMultiply );
+		// Rotate the basis to get the start of the row in the sprite frame. This is worked out from the centre of rotation
+		// (rather than stepped from the row above) so the sampling doesn't depend on how the drawing has been clipped.
+		const long long rowUFixed = ( static_cast<long long>( originX ) << 16 ) + static_cast<long long>( dUdXFixed ) * ( startX - blitX ) + static_cast<long long>( dUdYFixed ) * ( y - blitY );
+		const long long rowVFixed = ( static_cast<long long>( originY ) << 16 ) + static_cast<long long>( dVdXFixed ) * ( startX - blitX ) + static_cast<long long>( dVdYFixed ) * ( y - blitY );
 
-					// Source pixels are already multiplied by srcAlpha so we just apply the constant alpha multiplier
-					int destRed = constAlpha * ( ( src >> 16 ) & 0xFF );
-					int destGreen = constAlpha * ( ( src >> 8 ) & 0xFF );
-					int destBlue = constAlpha * ( src & 0xFF );
+		// Work out exactly which pixels on this row land inside the sprite using the same fixed point values we step with,
+		// so nothing inside the span needs a bounds check and nothing outside it is visited
 
-					uint32_t dest = *destPixels;
-					int invSrcAlpha = 0xFF - srcAlpha;
+		int spanStart = 0;
+		int spanEnd = rowLength;
+		ClipFixedPointSpan( rowUFixed, dUdXFixed, widthFixed, spanStart, spanEnd );
+		ClipFixedPointSpan( rowVFixed, dVdXFixed, heightFixed, spanStart, spanEnd );
 
-					// Apply a standard Alpha blend [ src*srcAlpha + dest*(1-SrcAlpha) ]
-					destRed += invSrcAlpha * ( ( dest >> 16 ) & 0xFF );
-					destGreen += invSrcAlpha * ( ( dest >> 8 ) & 0xFF );
-					destBlue += invSrcAlpha * ( dest & 0xFF );
+		int u = static_cast<int>( rowUFixed + static_cast<long long>( spanStart ) * dUdXFixed );
+		int v = static_cast<int>( rowVFixed + static_cast<long long>( spanStart ) * dVdXFixed );
 
-					// Bring back to the range 0-255
-					destRed >>= 8;
-					destGreen >>= 8;
-					destBlue >>= 8;
+		for( int x = spanStart; x < spanEnd; x += GATHER_SIZE )
+		{
+			int count = std::min( spanEnd - x, GATHER_SIZE );
 
-					// Put ARGB components back together again
-					*destPixels = 0xFF000000 | ( destRed << 16 ) | ( destGreen << 8 ) | destBlue;
-				}
+			for( int i = 0; i < count; i++ )
+			{
+				gathered[i] = pSrcBase[( u >> 16 ) + static_cast<size_t>( v >> 16 ) * srcPixelData.width];
+				u += dUdXFixed;
+				v += dVdXFixed;
 			}
 
-			destPixels++;
+			if( tinted )
+				TintRow( gathered, gathered, count, tint );
 
-			// Change the position in the sprite frame for changing X in the display
-			u += dUdX;
-			v += dVdX;
+			if( blendMode == BLEND_ADDITIVE )
+				AddMultipliedRow( destRow + x, gathered, count, alphaMultiply );
+			else
+				BlendMultipliedRow( destRow + x, gathered, count, alphaMultiply );
 		}
 
-		// Work out the change in the sprite frame for changing Y in the display
-		rowU += dUdY;
-		rowV += dVdY;
 		// Next row
-		destPixels += nextRow;
+		destRow += m_pRenderTarget->width;
 	}
 
 }
 
 
-void PlayBlitter::ClearRenderTarget( Pixel colour )
+void PlayBlitter::ClearRenderTarget( Pixel colour ) const
 {
-	Pixel* pBuffEnd = m_pRenderTarget->pPixels + ( m_pRenderTarget->width * m_pRenderTarget->height );
-	for( Pixel* pBuff = m_pRenderTarget->pPixels; pBuff < pBuffEnd; *pBuff++ = colour.bits );
-	m_pRenderTarget->preMultiplied = false;
+	for( int y = m_clipTop; y < m_clipBottom; y++ )
+	{
+		Pixel* pBuff = m_pRenderTarget->pPixels + ( static_cast<size_t>( m_pRenderTarget->width ) * y ) + m_clipLeft;
+		Pixel* pBuffEnd = pBuff + ( m_clipRight - m_clipLeft );
+		for( ; pBuff < pBuffEnd; *pBuff++ = colour.bits );
+	}
+
+	// Only written when it needs to be, as tiles of the same target can be cleared on different threads
+	if( m_pRenderTarget->preMultiplied )
+		m_pRenderTarget->preMultiplied = false;
 }
 
-void PlayBlitter::BlitBackground( PixelData& backgroundImage )
+void PlayBlitter::BlitBackground( const PixelData& backgroundImage ) const
 {
 	PLAY_ASSERT_MSG( backgroundImage.height == m_pRenderTarget->height && backgroundImage.width == m_pRenderTarget->width, "Background size doesn't match render target!" );
+
+	if( m_clipLeft >= m_clipRight )
+		return;
+
 	// Takes about 1ms for 720p screen on i7-8550U
-	memcpy( m_pRenderTarget->pPixels, backgroundImage.pPixels, sizeof( Pixel ) * m_pRenderTarget->width * m_pRenderTarget->height );
+	for( int y = m_clipTop; y < m_clipBottom; y++ )
+	{
+		size_t rowOffset = ( static_cast<size_t>( m_pRenderTarget->width ) * y ) + m_clipLeft;
+		memcpy( m_pRenderTarget->pPixels + rowOffset, backgroundImage.pPixels + rowOffset, sizeof( Pixel ) * ( m_clipRight - m_clipLeft ) );
+	}
 }
 
 
@@ -2262,9 +4334,10 @@ PlayGraphics::PlayGraphics( int bufferWidth, int bufferHeight, const char* path
 	m_blitter.SetRenderTarget( &m_playBuffer );
 
 	// Iterate through the directory
-	PLAY_ASSERT_MSG( std::filesystem::exists( path ), "PlayBuffer: Drectory provided does not exist." );
+	std::string nativePath = PlayNativePath( path );
+	PLAY_ASSERT_MSG( std::filesystem::exists( nativePath ), "PlayBuffer: Drectory provided does not exist." );
 
-	for( const auto& p : std::filesystem::directory_iterator( path ) )
+	for( const auto& p : std::filesystem::directory_iterator( nativePath ) )
 	{
 		// Switch everything to uppercase to avoid need to check case each time
 		std::string filename = p.path().string();
@@ -2274,7 +4347,7 @@ PlayGraphics::PlayGraphics( int bufferWidth, int bufferHeight, const char* path
 		if( filename.find( ".PNG" ) != std::string::npos )
 		{
 			std::ifstream png_infile;
-			png_infile.open( filename, std::ios::binary ); // Don't do this as part of the constructor or we lose 16 bytes!
+			png_infile.open( PlayNativePath( filename ), std::ios::binary ); // Don't do this as part of the constructor or we lose 16 bytes!
 
 			// If the PNG was opened okay
 			if( png_infile )
@@ -2284,7 +4357,7 @@ PlayGraphics::PlayGraphics( int bufferWidth, int bufferHeight, const char* path
 				// Now we check for .inf file for each sprite and load origins
 				int originX = 0, originY = 0;
 
-				std::string info_filename = filename.replace( filename.find( ".PNG" ), 4, ".INF" );
+				std::string info_filename = PlayNativePath( filename.replace( filename.find( ".PNG" ), 4, ".INF" ) );
 
 				if( std::filesystem::exists( info_filename ) )
 				{
@@ -2313,6 +4386,9 @@ PlayGraphics::PlayGraphics( int bufferWidth, int bufferHeight, const char* path
 
 PlayGraphics::~PlayGraphics()
 {
+	StopRenderThread();
+	StopWorkers();
+
 	for( Sprite& s : vSpriteData )
 	{
 		if( s.canvasBuffer.pPixels )
@@ -2428,6 +4504,9 @@ int PlayGraphics::AddSprite( const std::string& name, PixelData& pixelData, int
 	std::string spriteName = name;
 	for( char& c : spriteName ) c = static_cast<char>( toupper( c ) );
 
+	// Deferred drawing refers to the existing sprites, which can move when the vector grows
+	FlushDrawing();
+
 	Sprite s;
 	s.id = m_nTotalSprites++;
 	s.name = spriteName;
@@ -2447,10 +4526,15 @@ int PlayGraphics::AddSprite( const std::string& name, PixelData& pixelData, int
 	memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
 	PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
 	s.canvasBuffer.preMultiplied = true;
+	CreateSpriteFrames( s );
 
 	// Add the sprite to our vector
 	vSpriteData.push_back( s );
 
+	// Names which weren't found before could match the new sprite (earlier matches still come first)
+	for( auto it = m_spriteIdLookup.begin(); it != m_spriteIdLookup.end(); )
+		it = it->second == -1 ? m_spriteIdLookup.erase( it ) : std::next( it );
+
 	return s.id;
 }
 
@@ -2464,6 +4548,9 @@ int PlayGraphics::UpdateSprite( const std::string& name, PixelData& pixelData, i
 	{
 		if( s.name.find( spriteName ) != std::string::npos )
 		{
+			// Deferred drawing might still refer to the old buffer
+			FlushDrawing();
+
 			// delete the old premultiplied buffer
 			delete s.preMultAlpha.pPixels;
 
@@ -2482,6 +4569,8 @@ int PlayGraphics::UpdateSprite( const std::string& name, PixelData& pixelData, i
 			memset( s.preMultAlpha.pPixels, 0, sizeof( uint32_t ) * s.canvasBuffer.width * s.canvasBuffer.height );
 			PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, 0x00FFFFFF );
 			s.canvasBuffer.preMultiplied = true;
+			CreateSpriteFrames( s );
+			ClearCachedText( s.id );
 
 			return s.id;
 		}
@@ -2501,7 +4590,7 @@ int PlayGraphics::LoadBackground( const char* fileAndPath )
 	PLAY_ASSERT( correctSizeBuffer );
 
 	std::string pngFile( fileAndPath );
-	PLAY_ASSERT_MSG( std::filesystem::exists( fileAndPath ), "The background png does not exist at the given location." );
+	PLAY_ASSERT_MSG( std::filesystem::exists( PlayNativePath( fileAndPath ) ), "The background png does not exist at the given location." );
 	PlayWindow::LoadPNGImage( pngFile, backgroundImage ); // Allocates memory in function as we don't know the size
 
 	pSrc = backgroundImage.pPixels;
@@ -2519,7 +4608,7 @@ int PlayGraphics::LoadBackground( const char* fileAndPath )
 	}
 
 	// Free up the loading buffer
-	delete backgroundImage.pPixels;
+	delete[] backgroundImage.pPixels;
 	backgroundImage.pPixels = correctSizeBuffer;
 
 	vBackgroundData.push_back( backgroundImage );
@@ -2536,12 +4625,22 @@ int PlayGraphics::GetSpriteId( const char* name ) const
 	std::string tofind( name );
 	for( char& c : tofind ) c = static_cast<char>( toupper( c ) );
 
+	auto found = m_spriteIdLookup.find( tofind );
+	if( found != m_spriteIdLookup.end() )
+		return found->second;
+
+	int spriteId = -1;
 	for( const Sprite& s : vSpriteData )
 	{
 		if( s.name.find( tofind ) != std::string::npos )
-			return s.id;
+		{
+			spriteId = s.id;
+			break;
+		}
 	}
-	return -1;
+
+	m_spriteIdLookup.emplace( std::move( tofind ), spriteId );
+	return spriteId;
 }
 
 const std::string& PlayGraphics::GetSpriteName( int spriteId )
@@ -2621,7 +4720,7 @@ void PlayGraphics::SetSpriteOrigins( const char* rootName, Vector2f newOrigin, b
 // Drawing functions
 //********************************************************************************************************************************
 
-void PlayGraphics::DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply ) const
+void PlayGraphics::DrawTransparent( int spriteId, Point2f pos, int frameIndex, float alphaMultiply, Pixel tint ) const
 {
 	const Sprite& spr = vSpriteData[spriteId];
 	int destx = static_cast<int>( pos.x + 0.5f ) - spr.originX;
@@ -2633,10 +4732,26 @@ void PlayGraphics::DrawTransparent( int spriteId, Point2f pos, int frameIndex, f
 	int pixelY = frameY * spr.height;
 	int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
 
-	m_blitter.BlitPixels( spr.preMultAlpha, frameOffset, destx, desty, spr.width, spr.height, alphaMultiply );
+	// Only the trimmed part of the frame has anything to draw
+	const SpriteFrame& frame = spr.frames[frameIndex];
+	frameOffset += frame.trimX + ( spr.canvasBuffer.width * frame.trimY );
+
+	DrawCommand command;
+	command.type = DrawCommand::DRAW_BLIT_SPANS;
+	command.source = spr.preMultAlpha;
+	command.sourceOffset = frameOffset;
+	command.pSpans = &frame.spans;
+	command.x = destx + frame.trimX;
+	command.y = desty + frame.trimY;
+	command.width = frame.trimWidth;
+	command.height = frame.trimHeight;
+	command.alphaMultiply = alphaMultiply;
+	command.tint = tint;
+	command.spriteFrame = ( spriteId << 8 ) | ( frameIndex & 0xFF );
+	Submit( command );
 };
 
-void PlayGraphics::DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale, float alphaMultiply ) const
+void PlayGraphics::DrawRotated( int spriteId, Point2f pos, int frameIndex, float angle, float scale, float alphaMultiply, Pixel tint ) const
 {
 	const Sprite& spr = vSpriteData[spriteId];
 	int destx = static_cast<int>( pos.x + 0.5f );
@@ -2648,7 +4763,112 @@ void PlayGraphics::DrawRotated( int spriteId, Point2f pos, int frameIndex, float
 	int pixelY = frameY * spr.height;
 	int frameOffset = pixelX + ( spr.canvasBuffer.width * pixelY );
 
-	m_blitter.RotateScalePixels( spr.preMultAlpha, frameOffset, destx, desty, spr.width, spr.height, spr.originX, spr.originY, angle, scale, alphaMultiply );
+	// Only the trimmed part of the frame has anything to draw, so the origin is made relative to that instead
+	const SpriteFrame& frame = spr.frames[frameIndex];
+	frameOffset += frame.trimX + ( spr.canvasBuffer.width * frame.trimY );
+	int originX = spr.originX - frame.trimX;
+	int originY = spr.originY - frame.trimY;
+
+	// The furthest any pixel can move under the transform is (roughly) its distance from the origin multiplied by the
+	// change in scale plus the scaled angle, so check the sprite's furthest corner against the tolerance
+	float angleFromIdentity = fabsf( remainderf( angle, 2.0f * PLAY_PI ) );
+	float cornerX = static_cast<float>( std::max( abs( originX ), abs( frame.trimWidth - originX ) ) );
+	float cornerY = static_cast<float>( std::max( abs( originY ), abs( frame.trimHeight - originY ) ) );
+	float maxDrift = sqrtf( cornerX * cornerX + cornerY * cornerY ) * ( fabsf( scale - 1.0f ) + scale * angleFromIdentity );
+
+	DrawCommand command;
+	command.source = spr.preMultAlpha;
+	command.sourceOffset = frameOffset;
+	command.width = frame.trimWidth;
+	command.height = frame.trimHeight;
+	command.alphaMultiply = alphaMultiply;
+	command.tint = tint;
+	command.spriteFrame = ( spriteId << 8 ) | ( frameIndex & 0xFF );
+
+	if( maxDrift <= m_rotationTolerance )
+	{
+		command.type = DrawCommand::DRAW_BLIT_SPANS;
+		command.pSpans = &frame.spans;
+		command.x = destx - originX;
+		command.y = desty - originY;
+	}
+	else
+	{
+		command.type = DrawCommand::DRAW_ROTATE;
+		command.x = destx;
+		command.y = desty;
+		command.originX = originX;
+		command.originY = originY;
+		command.angle = angle;
+		command.scale = scale;
+	}
+
+	Submit( command );
+}
+
+void PlayGraphics::DrawInstances( int spriteId, int frameIndex, int count, const float* pPosX, const float* pPosY, const float* pScale, const float* pAlpha, Pixel tint, PlayBlitter::BlendMode blendMode ) const
+{
+	PLAY_ASSERT_MSG( spriteId >= 0 && spriteId < static_cast<int>( vSpriteData.size() ), "Trying to draw instances of an invalid sprite!" );
+
+	const Sprite& spr = vSpriteData[spriteId];
+	frameIndex = frameIndex % spr.totalCount;
+	int frameX = frameIndex % spr.hCount;
+	int frameY = frameIndex / spr.hCount;
+	int frameOffset = ( frameX * spr.width ) + ( spr.canvasBuffer.width * frameY * spr.height );
+
+	// A completely transparent frame has nothing to draw
+	const SpriteFrame& frame = spr.frames[frameIndex];
+	if( frame.trimWidth == 0 )
+		return;
+
+	frameOffset += frame.trimX + ( spr.canvasBuffer.width * frame.trimY );
+	int originX = spr.originX - frame.trimX;
+	int originY = spr.originY - frame.trimY;
+
+	// Without rotation, the furthest a pixel can move is its distance from the origin multiplied by the change in scale
+	// (the same test DrawRotated makes)
+	float cornerX = static_cast<float>( std::max( abs( originX ), abs( frame.trimWidth - originX ) ) );
+	float cornerY = static_cast<float>( std::max( abs( originY ), abs( frame.trimHeight - originY ) ) );
+	float cornerDistance = sqrtf( cornerX * cornerX + cornerY * cornerY );
+
+	// Only the position, scale and opacity change from one instance to the next
+	DrawCommand command;
+	command.source = spr.preMultAlpha;
+	command.sourceOffset = frameOffset;
+	command.pSpans = &frame.spans;
+	command.width = frame.trimWidth;
+	command.height = frame.trimHeight;
+	command.originX = originX;
+	command.originY = originY;
+	command.tint = tint;
+	command.blendMode = blendMode;
+	command.spriteFrame = ( spriteId << 8 ) | ( frameIndex & 0xFF );
+
+	for( int i = 0; i < count; i++ )
+	{
+		if( pScale[i] <= 0.0f || pAlpha[i] <= 0.0f )
+			continue;
+
+		int destx = static_cast<int>( pPosX[i] + 0.5f );
+		int desty = static_cast<int>( pPosY[i] + 0.5f );
+		command.alphaMultiply = pAlpha[i];
+
+		if( cornerDistance * fabsf( pScale[i] - 1.0f ) <= m_rotationTolerance )
+		{
+			command.type = DrawCommand::DRAW_BLIT_SPANS;
+			command.x = destx - originX;
+			command.y = desty - originY;
+		}
+		else
+		{
+			command.type = DrawCommand::DRAW_ROTATE;
+			command.x = destx;
+			command.y = desty;
+			command.scale = pScale[i];
+		}
+
+		Submit( command );
+	}
 }
 
 
@@ -2656,7 +4876,19 @@ void PlayGraphics::DrawBackground( int backgroundId )
 {
 	PLAY_ASSERT_MSG( m_playBuffer.pPixels, "Trying to draw background without initialising display!" );
 	PLAY_ASSERT_MSG( vBackgroundData.size() > static_cast<size_t>(backgroundId), "Background image out of range!" );
-	m_blitter.BlitBackground( vBackgroundData[backgroundId] );
+
+	DrawCommand command;
+	command.type = DrawCommand::DRAW_BACKGROUND;
+	command.source = vBackgroundData[backgroundId];
+	Submit( command );
+}
+
+void PlayGraphics::ClearBuffer( Pixel colour )
+{
+	DrawCommand command;
+	command.type = DrawCommand::DRAW_CLEAR;
+	command.pix = colour;
+	Submit( command );
 }
 
 void PlayGraphics::ColourSprite( int spriteId, int r, int g, int b )
@@ -2666,35 +4898,271 @@ void PlayGraphics::ColourSprite( int spriteId, int r, int g, int b )
 	Sprite& s = vSpriteData[spriteId];
 	uint32_t col = ( ( r & 0xFF ) << 16 ) | ( ( g & 0xFF ) << 8 ) | ( b & 0xFF );
 
+	// Any deferred drawing of this sprite has to use the old colour
+	FlushDrawing();
+
 	PreMultiplyAlpha( s.canvasBuffer.pPixels, s.preMultAlpha.pPixels, s.canvasBuffer.width, s.canvasBuffer.height, s.width, 1.0f, col );
 	s.canvasBuffer.preMultiplied = true;
+	ClearCachedText( spriteId );
+}
+
+int PlayGraphics::DrawString( int fontId, Point2f pos, const std::string& text ) const
+{
+	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+
+	const CachedText* pCached = GetCachedText( fontId, text );
+
+	// Left of the screen the positions of the characters round differently, so they may not line up with the image
+	if( pCached && !pCached->pixels.empty() && pos.x + 0.5f >= 0.0f )
+	{
+		const Sprite& spr = vSpriteData[fontId];
+
+		DrawCommand command;
+		command.type = DrawCommand::DRAW_BLIT_SPANS;
+		command.source = pCached->image;
+		command.pSpans = &pCached->spans;
+		command.x = static_cast<int>( pos.x + 0.5f ) - spr.originX + pCached->imageX;
+		command.y = static_cast<int>( pos.y + 0.5f ) - spr.originY + pCached->imageY;
+		command.width = pCached->image.width;
+		command.height = pCached->image.height;
+		Submit( command );
+		return pCached->width;
+	}
+
+	// Strings drawn for the first time aren't composited yet, and characters which overlap each other can't be as blending doesn't keep the alpha
+	int width = 0;
+
+	for( char c : text )
+	{
+		Draw( fontId, { pos.x + width, pos.y }, c - 32 );
+		width += GetFontCharWidth( fontId, c );
+	}
+	return width;
+}
+
+int PlayGraphics::DrawStringCentred( int fontId, Point2f pos, const std::string& text ) const
+{
+	int totalWidth = GetStringWidth( fontId, text );
+
+	pos.x -= totalWidth / 2;
+
+	DrawString( fontId, pos, text );
+	return totalWidth;
 }
 
-int PlayGraphics::DrawString( int fontId, Point2f pos, std::string text ) const
+int PlayGraphics::GetStringWidth( int fontId, const std::string& text ) const
 {
 	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
 
 	int width = 0;
+	for( char c : text )
+		width += GetFontCharWidth( fontId, c );
+	return width;
+}
+
+int PlayGraphics::MeasureText( int fontId, const std::string& text, int& left, int& top, int& right, int& bottom ) const
+{
+	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
+
+	const Sprite& spr = vSpriteData[fontId];
+	left = top = std::numeric_limits<int>::max();
+	right = bottom = std::numeric_limits<int>::min();
+	int charX = 0;
+
+	for( char c : text )
+	{
+		const GlyphMetrics& glyph = spr.glyphs[( c - 32 ) % spr.totalCount];
+		if( glyph.left < glyph.right )
+		{
+			left = std::min( left, charX + glyph.left );
+			top = std::min( top, static_cast<int>( glyph.top ) );
+			right = std::max( right, charX + glyph.right );
+			bottom = std::max( bottom, static_cast<int>( glyph.bottom ) );
+		}
+		charX += GetFontCharWidth( fontId, c );
+	}
+
+	if( left >= right )
+	{
+		left = top = right = bottom = 0;
+		return charX;
+	}
+
+	left -= spr.originX;
+	right -= spr.originX;
+	top -= spr.originY;
+	bottom -= spr.originY;
+	return charX;
+}
+
+const PlayGraphics::CachedText* PlayGraphics::GetCachedText( int fontId, const std::string& text ) const
+{
+	// FNV-1a hash of the font and text, so finding a string doesn't have to copy it
+	uint64_t hash = 0xCBF29CE484222325ull;
+	hash = ( hash ^ static_cast<uint32_t>( fontId ) ) * 0x100000001B3ull;
+	for( char c : text )
+		hash = ( hash ^ static_cast<uint8_t>( c ) ) * 0x100000001B3ull;
+
+	auto found = m_textCache.find( hash );
+	if( found != m_textCache.end() )
+	{
+		// Deferred drawing could still be using the other string's image, so it can't be replaced
+		if( found->second.fontId != fontId || found->second.text != text )
+			return nullptr;
+
+		CachedText& cached = found->second;
+		cached.lastUsedFrame = m_textFrame;
+
+		// Only try once a frame if the cache was too full
+		if( !cached.composited && cached.lastCompositeFrame != m_textFrame )
+		{
+			cached.lastCompositeFrame = m_textFrame;
+			cached.composited = CompositeText( cached );
+		}
+		return &cached;
+	}
+
+	// The first time a string is drawn it's drawn a character at a time
+	CachedText& cached = m_textCache[hash];
+	cached.fontId = fontId;
+	cached.text = text;
+	cached.lastUsedFrame = m_textFrame;
+	return &cached;
+}
+
+bool PlayGraphics::CompositeText( CachedText& cached ) const
+{
+	const Sprite& spr = vSpriteData[cached.fontId];
+
+	// The image is kept relative to the first character's frame, so it doesn't depend on the font's origin
+	int left, top, right, bottom;
+	cached.width = MeasureText( cached.fontId, cached.text, left, top, right, bottom );
+	left += spr.originX;
+	right += spr.originX;
+	top += spr.originY;
+	bottom += spr.originY;
+
+	// Nothing visible to draw (or too wide for a span list)
+	if( left >= right || right - left > 0xFFFF )
+		return true;
+
+	// Check there's room for the pixels before doing any work, and again once the size of the span list is known
+	size_t bytes = static_cast<size_t>( right - left ) * ( bottom - top ) * sizeof( Pixel );
+	if( !MakeRoomForCachedText( bytes ) )
+		return false;
+
+	cached.imageX = left;
+	cached.imageY = top;
+	cached.image.width = right - left;
+	cached.image.height = bottom - top;
+	cached.image.preMultiplied = true;
+	cached.pixels.assign( static_cast<size_t>( cached.image.width ) * cached.image.height, Pixel( 0xFF000000 ) );
+	cached.image.pPixels = cached.pixels.data();
+
+	// Copy the visible spans of each character into place
+	int charX = 0;
+
+	for( char c : cached.text )
+	{
+		int frameIndex = ( c - 32 ) % spr.totalCount;
+		const SpriteFrame& frame = spr.frames[frameIndex];
+		int frameOffset = ( ( frameIndex % spr.hCount ) * spr.width ) + frame.trimX + ( spr.preMultAlpha.width * ( ( ( frameIndex / spr.hCount ) * spr.height ) + frame.trimY ) );
+
+		for( int y = 0; y < frame.trimHeight; y++ )
+		{
+			const Pixel* pSrcRow = spr.preMultAlpha.pPixels + frameOffset + ( static_cast<size_t>( spr.preMultAlpha.width ) * y );
+			Pixel* pDestRow = cached.image.pPixels + ( charX + frame.trimX - left ) + ( static_cast<size_t>( cached.image.width ) * ( frame.trimY + y - top ) );
+
+			for( int i = frame.spans.rowStart[y]; i < frame.spans.rowStart[y + 1]; i++ )
+			{
+				const PixelSpan& span = frame.spans.spans[i];
+				for( int x = span.start; x < span.start + span.length; x++ )
+				{
+					if( pDestRow[x].bits < 0xFF000000 )
+					{
+						cached.pixels.clear();
+						cached.pixels.shrink_to_fit();
+						return true;
+					}
+					pDestRow[x] = pSrcRow[x];
+				}
+			}
+		}
+		charX += GetFontCharWidth( cached.fontId, c );
+	}
+
+	// Fully transparent pixels store how many more follow them in the row, as PreMultiplyAlpha does
+	for( int y = 0; y < cached.image.height; y++ )
+	{
+		Pixel* pRow = cached.image.pPixels + ( static_cast<size_t>( cached.image.width ) * y );
+		uint32_t repeats = 0;
+
+		for( int x = cached.image.width - 1; x >= 0; x-- )
+		{
+			if( pRow[x].bits >= 0xFF000000 )
+				pRow[x].bits = 0xFF000000 | repeats++;
+			else
+				repeats = 0;
+		}
+	}
+
+	PlayBlitter::BuildSpanList( cached.image, 0, cached.image.width, cached.image.height, cached.spans );
+
+	bytes += ( cached.spans.spans.capacity() * sizeof( PixelSpan ) ) + ( cached.spans.rowStart.capacity() * sizeof( int ) );
+	if( !MakeRoomForCachedText( bytes ) )
+	{
+		cached.pixels = std::vector<Pixel>();
+		cached.spans = SpanList();
+		return false;
+	}
+
+	cached.bytes = bytes;
+	m_textCacheBytes += bytes;
+	return true;
+}
+
+bool PlayGraphics::MakeRoomForCachedText( size_t bytes ) const
+{
+	if( m_textCacheBytes + bytes <= TEXT_CACHE_BYTES )
+		return true;
+
+	std::vector< std::pair< int, uint64_t > > unused;
+	for( const auto& entry : m_textCache )
+	{
+		if( entry.second.bytes > 0 && m_textFrame - entry.second.lastUsedFrame > TEXT_FRAMES_IN_FLIGHT )
+			unused.push_back( { entry.second.lastUsedFrame, entry.first } );
+	}
+	std::sort( unused.begin(), unused.end() );
 
-	for( char c : text )
+	for( const auto& entry : unused )
 	{
-		Draw( fontId, { pos.x + width, pos.y }, c - 32 );
-		width += GetFontCharWidth( fontId, c );
+		if( m_textCacheBytes + bytes <= TEXT_CACHE_BYTES )
+			break;
+		EraseCachedText( m_textCache.find( entry.second ) );
 	}
-	return width;
+
+	return m_textCacheBytes + bytes <= TEXT_CACHE_BYTES;
 }
 
-int PlayGraphics::DrawStringCentred( int fontId, Point2f pos, std::string text ) const
+std::unordered_map< uint64_t, PlayGraphics::CachedText >::iterator PlayGraphics::EraseCachedText( std::unordered_map< uint64_t, CachedText >::iterator it ) const
 {
-	int totalWidth = 0;
+	m_textCacheBytes -= it->second.bytes;
+	return m_textCache.erase( it );
+}
 
-	for( char c : text )
-		totalWidth += GetFontCharWidth( fontId, c );
+void PlayGraphics::ExpireCachedText()
+{
+	// The frames still being drawn only use strings drawn within the last couple of frames
+	for( auto it = m_textCache.begin(); it != m_textCache.end(); )
+		it = m_textFrame - it->second.lastUsedFrame > TEXT_CACHE_FRAMES ? EraseCachedText( it ) : std::next( it );
 
-	pos.x -= totalWidth / 2;
+	m_textFrame++;
+}
 
-	DrawString( fontId, pos, text );
-	return totalWidth;
+void PlayGraphics::ClearCachedText( int fontId )
+{
+	for( auto it = m_textCache.begin(); it != m_textCache.end(); )
+		it = it->second.fontId == fontId ? EraseCachedText( it ) : std::next( it );
 }
 
 int PlayGraphics::DrawChar( int fontId, Point2f pos, char c ) const
@@ -2714,7 +5182,14 @@ int PlayGraphics::DrawCharRotated( int fontId, Point2f pos, float angle, float s
 int PlayGraphics::GetFontCharWidth( int fontId, char c ) const
 {
 	PLAY_ASSERT_MSG( fontId >= 0 && fontId < m_nTotalSprites, "Trying to use invalid sprite id for font" );
-	return (vSpriteData[fontId].canvasBuffer.pPixels + ( c - 32 ))->b; // character width hidden in pixel data
+	const Sprite& spr = vSpriteData[fontId];
+
+	// Characters beyond the font's frames still read their width from the canvas, as they always have
+	int index = c - 32;
+	if( index >= 0 && index < static_cast<int>( spr.glyphs.size() ) )
+		return spr.glyphs[index].advance;
+
+	return (spr.canvasBuffer.pPixels + index)->b; // character width hidden in pixel data
 }
 
 
@@ -2760,6 +5235,25 @@ bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float an
 		s2PixelCollTL[2 * i + 1] = s2PixelColl[2 * i + 1] + s2.originY;
 	}
 
+	//wrap both frame indexes just in case.
+	frame_1 = frame_1 % s1.totalCount;
+	frame_2 = frame_2 % s2.totalCount;
+
+	//Shrink the collision boxes to the trimmed frames as there's nothing to collide with outside them.
+	const SpriteFrame& f1 = s1.frames[frame_1];
+	const SpriteFrame& f2 = s2.frames[frame_2];
+	s1PixelCollTL[0] = std::max( s1PixelCollTL[0], f1.trimX );
+	s1PixelCollTL[1] = std::max( s1PixelCollTL[1], f1.trimY );
+	s1PixelCollTL[2] = std::min( s1PixelCollTL[2], f1.trimX + f1.trimWidth );
+	s1PixelCollTL[3] = std::min( s1PixelCollTL[3], f1.trimY + f1.trimHeight );
+	s2PixelCollTL[0] = std::max( s2PixelCollTL[0], f2.trimX );
+	s2PixelCollTL[1] = std::max( s2PixelCollTL[1], f2.trimY );
+	s2PixelCollTL[2] = std::min( s2PixelCollTL[2], f2.trimX + f2.trimWidth );
+	s2PixelCollTL[3] = std::min( s2PixelCollTL[3], f2.trimY + f2.trimHeight );
+
+	if( s1PixelCollTL[0] >= s1PixelCollTL[2] || s1PixelCollTL[1] >= s1PixelCollTL[3] || s2PixelCollTL[0] >= s2PixelCollTL[2] || s2PixelCollTL[1] >= s2PixelCollTL[3] )
+		return false;
+
 	//in screen
 	float cosAngle1 = cos( angle_1 );
 	float sinAngle1 = sin( angle_1 );
@@ -2790,7 +5284,6 @@ bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float an
 
 	int s2Width = s2.width;
 	int s2Height = s2.height;
-	int s1Width = s1.width;
 
 	float cosAngleDiff = cos( angle_2 - angle_1 );
 	float sinAngleDiff = sin( angle_2 - angle_1 );
@@ -2838,10 +5331,6 @@ bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float an
 	}
 	else
 	{
-		//wrap both frame indexes just in case.
-		frame_1 = frame_1 % s1.totalCount;
-		frame_2 = frame_2 % s2.totalCount;
-
 		//clip so we loop through sprite 1.
 		//Restrict the range we look in for pixel based collisions.
 		minv = ( minv < s1PixelCollTL[1] ) ? static_cast<float>( s1PixelCollTL[1] ) : minv;
@@ -2859,57 +5348,65 @@ bool PlayGraphics::SpriteCollide( int id_1, Point2f pos_1, int frame_1, float an
 		int imaxu = static_cast<int>( maxu );
 		int imaxv = static_cast<int>( maxv );
 
-		float startinga = minCa;
-		float startingb = minCb;
-
-		float rowstarta = startinga;
-		float rowstartb = startingb;
+		//When the sprites have the same rotation the masks line up, so whole words of both masks can be ANDed together.
+		if( sinAngleDiff == 0.0f && cosAngleDiff == 1.0f )
+		{
+			//Sprite 2 pixel a,b is at u,v = a + offsetu, b + offsetv in sprite 1 (to the nearest pixel centre).
+			int offsetu = static_cast<int>( ceil( originDiffu - 0.5f ) );
+			int offsetv = static_cast<int>( ceil( originDiffv - 0.5f ) );
+			int startu = std::max( s1PixelCollTL[0], s2PixelCollTL[0] + offsetu );
+			int endu = std::min( s1PixelCollTL[2], s2PixelCollTL[2] + offsetu );
+			int startv = std::max( s1PixelCollTL[1], s2PixelCollTL[1] + offsetv );
+			int endv = std::min( s1PixelCollTL[3], s2PixelCollTL[3] + offsetv );
+
+			for( int v{ startv }; v < endv; v++ )
+			{
+				const uint64_t* mask1Row = f1.collisionMask.data() + static_cast<size_t>( f1.maskStride ) * ( v - f1.trimY );
+				const uint64_t* mask2Row = f2.collisionMask.data() + static_cast<size_t>( f2.maskStride ) * ( v - offsetv - f2.trimY );
 
-		//Set up starting and finishing pointers for both the sprite 1 buffer and sprite 2 buffer 
-		//starting pointer for the sprite 1 buffer is the minu and minv.
-		int sprite1Offset = s1Width * frame_1 + iminu + iminv * s1.canvasBuffer.width;
-		Pixel* sprite1Src = s1.canvasBuffer.pPixels + sprite1Offset;
+				for( int u{ startu }; u < endu; u += 64 )
+				{
+					uint64_t overlap = ReadMaskBits( mask1Row, u - f1.trimX ) & ReadMaskBits( mask2Row, u - offsetu - f2.trimX );
+					if( endu - u < 64 )
+						overlap &= ( uint64_t( 1 ) << ( endu - u ) ) - 1;
+					if( overlap )
+						return true;
+				}
+			}
+			return false;
+		}
 
-		//The base pointer for the sprite2 will just be start of the correct frame in the canvas buffer.
-		int sprite2Offset = s2Width * frame_2;
-		Pixel* sprite2Base = s2.canvasBuffer.pPixels + sprite2Offset;
-		//Define the number which we need to add to get down a row in sprite1.
-		int sprite1ChangeRow = s1.canvasBuffer.width - ( imaxu - iminu );
+		float rowstarta = minCa;
+		float rowstartb = minCb;
 
 		//Start of double for loop.
-		//Go through the overlapping region (warning may go out of the buffer of sprite 2.)
+		//Go through the overlapping region, sampling the collision masks of both sprites.
 		for( int v{ iminv }; v < imaxv; v++ )
 		{
 			//store a and b to be the start of the row.
 			float a = rowstarta;
 			float b = rowstartb;
+			const uint64_t* mask1Row = f1.collisionMask.data() + static_cast<size_t>( f1.maskStride ) * ( v - f1.trimY );
 
 			for( int u{ iminu }; u < imaxu; u++ )
 			{
-
-				//Edit this part to add a collision box.
-				//If we are in sprite 2 then extract the look at the pixels.
+				//If we are in sprite 2's collision box then look at the pixels.
 				if( a >= s2PixelCollTL[0] && b >= s2PixelCollTL[1] && a < s2PixelCollTL[2] && b < s2PixelCollTL[3] )
 				{
-					int sprite2Pixel = static_cast<int>( a ) + static_cast<int>( b ) * s2.canvasBuffer.width;
-					Pixel sprite2Src = *( sprite2Base + sprite2Pixel );
-
 					//If both pixels at that position are opaque then there is a collision. 
-					if( sprite2Src.bits > 0x00FFFFFF && (*sprite1Src).bits > 0x00FFFFFF )
+					int maskU = u - f1.trimX;
+					if( ( mask1Row[maskU >> 6] >> ( maskU & 63 ) ) & 1 )
 					{
-						return true;
+						int maskA = static_cast<int>( a ) - f2.trimX;
+						const uint64_t* mask2Row = f2.collisionMask.data() + static_cast<size_t>( f2.maskStride ) * ( static_cast<int>( b ) - f2.trimY );
+						if( ( mask2Row[maskA >> 6] >> ( maskA & 63 ) ) & 1 )
+							return true;
 					}
-
 				}
 				//add change in for going along u. go along a row.
 				a += cosAngleDiff;
 				b += -sinAngleDiff;
-
-				sprite1Src++;
-
 			}
-			//increment for row of sprite 1.
-			sprite1Src += sprite1ChangeRow;
 
 			//work out start of next row based on start of previous row. 
 			rowstarta += sinAngleDiff;
@@ -2978,6 +5475,89 @@ void PlayGraphics::PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int
 	}
 }
 
+void PlayGraphics::CreateSpriteFrames( Sprite& s )
+{
+	// Only the alpha affects the frames, so they don't need recreating when the sprite is coloured
+	s.frames.resize( s.totalCount );
+	s.glyphs.resize( s.totalCount );
+
+	for( int frameIndex = 0; frameIndex < s.totalCount; frameIndex++ )
+	{
+		SpriteFrame& frame = s.frames[frameIndex];
+		int pixelX = ( frameIndex % s.hCount ) * s.width;
+		int pixelY = ( frameIndex / s.hCount ) * s.height;
+		const Pixel* pFrame = s.preMultAlpha.pPixels + pixelX + ( static_cast<size_t>( s.preMultAlpha.width ) * pixelY );
+
+		// Find the smallest rectangle containing every pixel which isn't fully transparent
+		int minX = s.width, minY = s.height, maxX = -1, maxY = -1;
+
+		for( int y = 0; y < s.height; y++ )
+		{
+			for( int x = 0; x < s.width; x++ )
+			{
+				if( pFrame[x + static_cast<size_t>( s.preMultAlpha.width ) * y].bits < 0xFF000000 )
+				{
+					minX = std::min( minX, x );
+					maxX = std::max( maxX, x );
+					minY = std::min( minY, y );
+					maxY = std::max( maxY, y );
+				}
+			}
+		}
+
+		if( maxX < 0 )
+		{
+			frame.trimX = frame.trimY = frame.trimWidth = frame.trimHeight = 0;
+		}
+		else
+		{
+			frame.trimX = minX;
+			frame.trimY = minY;
+			frame.trimWidth = maxX + 1 - minX;
+			frame.trimHeight = maxY + 1 - minY;
+		}
+
+		int trimOffset = pixelX + frame.trimX + ( s.preMultAlpha.width * ( pixelY + frame.trimY ) );
+		PlayBlitter::BuildSpanList( s.preMultAlpha, trimOffset, frame.trimWidth, frame.trimHeight, frame.spans );
+
+		// PlayFontTool hides each character's width in the blue channel of the canvas pixel with the same index as its frame
+		GlyphMetrics& glyph = s.glyphs[frameIndex];
+		glyph.advance = s.canvasBuffer.pPixels[frameIndex].b;
+		glyph.left = static_cast<int16_t>( frame.trimX );
+		glyph.top = static_cast<int16_t>( frame.trimY );
+		glyph.right = static_cast<int16_t>( frame.trimX + frame.trimWidth );
+		glyph.bottom = static_cast<int16_t>( frame.trimY + frame.trimHeight );
+
+		// The collision mask packs the same test SpriteCollide used to make on the canvas pixels into bits
+		// > The padding word at the end of each row lets ReadMaskBits read 64 bits from any position without a bounds check
+		frame.maskStride = ( ( frame.trimWidth + 63 ) / 64 ) + 1;
+		frame.collisionMask.assign( static_cast<size_t>( frame.maskStride ) * frame.trimHeight, 0 );
+
+		for( int y = 0; y < frame.trimHeight; y++ )
+		{
+			const Pixel* pCanvas = s.canvasBuffer.pPixels + pixelX + frame.trimX + ( static_cast<size_t>( s.canvasBuffer.width ) * ( pixelY + frame.trimY + y ) );
+			uint64_t* pMaskRow = frame.collisionMask.data() + static_cast<size_t>( frame.maskStride ) * y;
+
+			for( int x = 0; x < frame.trimWidth; x++ )
+			{
+				if( pCanvas[x].bits > 0x00FFFFFF )
+					pMaskRow[x >> 6] |= uint64_t( 1 ) << ( x & 63 );
+			}
+		}
+	}
+}
+
+uint64_t PlayGraphics::ReadMaskBits( const uint64_t* pMaskRow, int bit )
+{
+	int word = bit >> 6;
+	int shift = bit & 63;
+
+	if( shift == 0 )
+		return pMaskRow[word];
+
+	return ( pMaskRow[word] >> shift ) | ( pMaskRow[word + 1] << ( 64 - shift ) );
+}
+
 //********************************************************************************************************************************
 // Basic drawing functions
 //********************************************************************************************************************************
@@ -2987,7 +5567,12 @@ void PlayGraphics::PreMultiplyAlpha( Pixel* source, Pixel* dest, int width, int
 void PlayGraphics::DrawPixel( Point2f pos, Pixel srcPix )
 {
 	// Convert floating point co-ordinates to pixels
-	m_blitter.DrawPixel( static_cast<int>( pos.x + 0.5f ), static_cast<int>( pos.y + 0.5f ), srcPix );
+	DrawCommand command;
+	command.type = DrawCommand::DRAW_PIXEL;
+	command.x = static_cast<int>( pos.x + 0.5f );
+	command.y = static_cast<int>( pos.y + 0.5f );
+	command.pix = srcPix;
+	Submit( command );
 }
 
 void PlayGraphics::DrawLine( Point2f startPos, Point2f endPos, Pixel pix )
@@ -2998,86 +5583,505 @@ void PlayGraphics::DrawLine( Point2f startPos, Point2f endPos, Pixel pix )
 	int x2 = static_cast<int>( endPos.x + 0.5f );
 	int y2 = static_cast<int>( endPos.y + 0.5f );
 
-	m_blitter.DrawLine( x1, y1, x2, y2, pix );
-}
+	DrawCommand command;
+	command.type = DrawCommand::DRAW_LINE;
+	command.x = x1;
+	command.y = y1;
+	command.width = x2;
+	command.height = y2;
+	command.pix = pix;
+	Submit( command );
+}
+
+
+
+
+void PlayGraphics::DrawRect( Point2f topLeft, Point2f bottomRight, Pixel pix, bool fill )
+{
+	// Convert floating point co-ordinates to pixels
+	int x1 = static_cast<int>( topLeft.x + 0.5f );
+	int x2 = static_cast<int>( bottomRight.x + 0.5f );
+	int y1 = static_cast<int>( topLeft.y + 0.5f );
+	int y2 = static_cast<int>( bottomRight.y + 0.5f );
+
+	if( fill )
+	{
+		DrawCommand command;
+		command.type = DrawCommand::DRAW_RECT;
+		command.x = x1;
+		command.y = y1;
+		command.width = x2 - x1;
+		command.height = y2 - y1;
+		command.pix = pix;
+		Submit( command );
+	}
+	else
+	{
+		DrawLine( { x1, y1 }, { x2, y1 }, pix );
+		DrawLine( { x2, y1 }, { x2, y2 }, pix );
+		DrawLine( { x2, y2 }, { x1, y2 }, pix );
+		DrawLine( { x1, y2 }, { x1, y1 }, pix );
+	}
+}
+
+void PlayGraphics::DrawCircle( Point2f pos, int radius, Pixel pix )
+{
+	// Convert floating point co-ordinates to pixels
+	DrawCommand command;
+	command.type = DrawCommand::DRAW_CIRCLE;
+	command.x = static_cast<int>( pos.x + 0.5f );
+	command.y = static_cast<int>( pos.y + 0.5f );
+	command.width = radius;
+	command.pix = pix;
+	Submit( command );
+}
+
+void PlayGraphics::DrawPixelData( PixelData* pixelData, Point2f pos, float alpha )
+{
+	if( !pixelData->preMultiplied )
+	{
+		PreMultiplyAlpha( pixelData->pPixels, pixelData->pPixels, pixelData->width, pixelData->height, pixelData->width );
+		pixelData->preMultiplied = true;
+	}
+
+	DrawCommand command;
+	command.type = DrawCommand::DRAW_BLIT;
+	command.source = *pixelData;
+	command.x = static_cast<int>( pos.x );
+	command.y = static_cast<int>( pos.y );
+	command.width = pixelData->width;
+	command.height = pixelData->height;
+	command.alphaMultiply = alpha;
+	Submit( command );
+}
+
+//********************************************************************************************************************************
+// Deferred drawing functions
+//********************************************************************************************************************************
+
+void PlayGraphics::Submit( const DrawCommand& command ) const
+{
+	// Only drawing into the display buffer is deferred
+	if( !m_bDeferred || m_blitter.GetRenderTarget() != &m_playBuffer )
+	{
+		ExecuteDrawCommand( m_blitter, command );
+		return;
+	}
+
+	int left, top, right, bottom;
+	GetDrawCommandBounds( command, left, top, right, bottom );
+
+	left = std::max( left, 0 );
+	top = std::max( top, 0 );
+	right = std::min( right, m_playBuffer.width );
+	bottom = std::min( bottom, m_playBuffer.height );
+
+	// Nothing within the display buffer to draw
+	if( left >= right || top >= bottom )
+		return;
+
+	int index = static_cast<int>( m_vDrawCommands.size() );
+	PLAY_ASSERT_MSG( index < ( 1 << 28 ), "Too many drawing commands in one frame!" );
+
+	// Commands are drawn in order of layer, then sprite frame if the layer is sorted, then the order they were submitted
+	uint64_t layerKey = static_cast<uint64_t>( m_drawingLayer + 0x8000 ) << 48;
+	uint64_t spriteKey = m_bSortLayer && command.spriteFrame >= 0 ? static_cast<uint64_t>( ( command.spriteFrame + 1 ) & 0xFFFFF ) << 28 : 0;
+	m_vDrawCommands.push_back( command );
+	m_vDrawCommands.back().sortKey = layerKey | spriteKey | static_cast<uint64_t>( index );
+	m_bReordered = m_bReordered || m_drawingLayer != 0 || spriteKey != 0;
+
+	// Add the command to every tile it overlaps, so each tile keeps the submission order
+	for( int tileY = top / TILE_SIZE; tileY <= ( bottom - 1 ) / TILE_SIZE; tileY++ )
+	{
+		for( int tileX = left / TILE_SIZE; tileX <= ( right - 1 ) / TILE_SIZE; tileX++ )
+			m_vTileBins[( tileY * m_tileColumns ) + tileX].push_back( index );
+	}
+}
+
+void PlayGraphics::ExecuteDrawCommand( const PlayBlitter& blitter, const DrawCommand& command )
+{
+	switch( command.type )
+	{
+		case DrawCommand::DRAW_PIXEL:
+			blitter.DrawPixel( command.x, command.y, command.pix );
+			break;
+		case DrawCommand::DRAW_LINE:
+			blitter.DrawLine( command.x, command.y, command.width, command.height, command.pix );
+			break;
+		case DrawCommand::DRAW_BLIT:
+			blitter.BlitPixels( command.source, command.sourceOffset, command.x, command.y, command.width, command.height, command.alphaMultiply );
+			break;
+		case DrawCommand::DRAW_BLIT_SPANS:
+			blitter.BlitPixels( command.source, command.sourceOffset, *command.pSpans, command.x, command.y, command.width, command.height, command.alphaMultiply, command.tint, command.blendMode );
+			break;
+		case DrawCommand::DRAW_ROTATE:
+			blitter.RotateScalePixels( command.source, command.sourceOffset, command.x, command.y, command.width, command.height, command.originX, command.originY, command.angle, command.scale, command.alphaMultiply, command.tint, command.blendMode );
+			break;
+		case DrawCommand::DRAW_CLEAR:
+			blitter.ClearRenderTarget( command.pix );
+			break;
+		case DrawCommand::DRAW_BACKGROUND:
+			blitter.BlitBackground( command.source );
+			break;
+		case DrawCommand::DRAW_RECT:
+			blitter.FillRect( command.x, command.y, command.x + command.width, command.y + command.height, command.pix );
+			break;
+		case DrawCommand::DRAW_CIRCLE:
+			blitter.DrawCircle( command.x, command.y, command.width, command.pix );
+			break;
+	}
+}
+
+void PlayGraphics::GetDrawCommandBounds( const DrawCommand& command, int& left, int& top, int& right, int& bottom )
+{
+	switch( command.type )
+	{
+		case DrawCommand::DRAW_PIXEL:
+			left = command.x;
+			top = command.y;
+			right = command.x + 1;
+			bottom = command.y + 1;
+			break;
+		case DrawCommand::DRAW_LINE:
+			left = std::min( command.x, command.width );
+			top = std::min( command.y, command.height );
+			right = std::max( command.x, command.width ) + 1;
+			bottom = std::max( command.y, command.height ) + 1;
+			break;
+		case DrawCommand::DRAW_BLIT:
+		case DrawCommand::DRAW_BLIT_SPANS:
+		case DrawCommand::DRAW_RECT:
+			left = command.x;
+			top = command.y;
+			right = command.x + command.width;
+			bottom = command.y + command.height;
+			break;
+		case DrawCommand::DRAW_ROTATE:
+		{
+			// Whatever the angle, the image stays within a circle around the origin through its furthest corner
+			float cornerX = static_cast<float>( std::max( abs( command.originX ), abs( command.width - command.originX ) ) );
+			float cornerY = static_cast<float>( std::max( abs( command.originY ), abs( command.height - command.originY ) ) );
+			int radius = static_cast<int>( ceilf( sqrtf( cornerX * cornerX + cornerY * cornerY ) * fabsf( command.scale ) ) ) + 1;
+			left = command.x - radius;
+			top = command.y - radius;
+			right = command.x + radius + 1;
+			bottom = command.y + radius + 1;
+			break;
+		}
+		case DrawCommand::DRAW_CIRCLE:
+		{
+			// The outline can overshoot the radius by one pixel on its last step
+			int extent = abs( command.width ) + 1;
+			left = command.x - extent;
+			top = command.y - extent;
+			right = command.x + extent + 1;
+			bottom = command.y + extent + 1;
+			break;
+		}
+		case DrawCommand::DRAW_CLEAR:
+		case DrawCommand::DRAW_BACKGROUND:
+		default:
+			left = top = std::numeric_limits<int>::min();
+			right = bottom = std::numeric_limits<int>::max();
+			break;
+	}
+}
+
+void PlayGraphics::SetDeferredDrawing( bool deferred, int workerThreads )
+{
+	// Finish off anything already recorded before changing the workers
+	FlushDrawing();
+	StopWorkers();
+
+	m_bDeferred = deferred;
+
+	if( !m_bDeferred )
+	{
+		StopRenderThread();
+		return;
+	}
+
+	m_tileColumns = ( m_playBuffer.width + TILE_SIZE - 1 ) / TILE_SIZE;
+	int tileRows = ( m_playBuffer.height + TILE_SIZE - 1 ) / TILE_SIZE;
+	m_vTileBins.resize( static_cast<size_t>( m_tileColumns ) * tileRows );
+	m_vRasterBins.resize( m_vTileBins.size() );
+	m_vTileContents.resize( m_vTileBins.size() );
+	m_vTileChanged.resize( m_vTileBins.size() );
+
+	// The display buffer could have been drawn into directly while drawing wasn't deferred
+	InvalidateTiles();
+
+	if( workerThreads < 0 )
+		workerThreads = std::max( static_cast<int>( std::thread::hardware_concurrency() ) - 1, 0 );
+
+	for( int i = 0; i < workerThreads; i++ )
+		m_vWorkers.emplace_back( &PlayGraphics::RasterizeWorker, this, m_workGeneration );
+}
+
+void PlayGraphics::FlushDrawing()
+{
+	// The render thread could still be drawing the previous frame into the display buffer
+	WaitForRenderThread();
+
+	if( m_vDrawCommands.empty() )
+		return;
+
+	m_vDrawCommands.swap( m_vRasterCommands );
+	m_vTileBins.swap( m_vRasterBins );
+	std::swap( m_bReordered, m_bRasterReordered );
+	RasterizeFrame();
+}
+
+void PlayGraphics::SetDrawingLayer( int layer, bool sortBySprite )
+{
+	PLAY_ASSERT_MSG( layer >= -0x8000 && layer < 0x8000, "Drawing layers must be between -32768 and 32767" );
+	m_drawingLayer = layer;
+	m_bSortLayer = sortBySprite;
+}
+
+void PlayGraphics::SetPipelinedDrawing( bool pipelined )
+{
+	if( pipelined == GetPipelinedDrawing() )
+		return;
+
+	if( !pipelined )
+	{
+		StopRenderThread();
+		return;
+	}
+
+	if( !m_bDeferred )
+		SetDeferredDrawing( true );
+
+	m_renderThread = std::thread( &PlayGraphics::RenderThread, this );
+}
+
+void PlayGraphics::PresentFrame( std::function<void( int top, int bottom )> present )
+{
+	m_drawingLayer = 0;
+	m_bSortLayer = false;
+	ExpireCachedText();
+
+	if( !m_bDeferred )
+	{
+		present( 0, m_playBuffer.height );
+		return;
+	}
+
+	if( !GetPipelinedDrawing() )
+	{
+		FlushDrawing();
+		int top, bottom;
+		GetChangedRows( top, bottom );
+		present( top, bottom );
+		return;
+	}
+
+	// The render thread is done with its commands once the previous frame is finished, so they can be swapped for this frame's
+	WaitForRenderThread();
+
+	m_vDrawCommands.swap( m_vRasterCommands );
+	m_vTileBins.swap( m_vRasterBins );
+	std::swap( m_bReordered, m_bRasterReordered );
+
+	{
+		std::lock_guard<std::mutex> lock( m_renderMutex );
+		m_renderPresent = std::move( present );
+		m_bFramePending = true;
+	}
+	m_renderStart.notify_one();
+}
+
+void PlayGraphics::RenderThread()
+{
+	while( true )
+	{
+		{
+			std::unique_lock<std::mutex> lock( m_renderMutex );
+			m_renderStart.wait( lock, [this]() { return m_bStopRenderThread || m_bFramePending; } );
+
+			if( !m_bFramePending )
+				return;
+		}
+
+		RasterizeFrame();
+		int top, bottom;
+		GetChangedRows( top, bottom );
+		m_renderPresent( top, bottom );
+
+		{
+			std::lock_guard<std::mutex> lock( m_renderMutex );
+			m_bFramePending = false;
+		}
+		m_renderDone.notify_all();
+	}
+}
+
+void PlayGraphics::WaitForRenderThread()
+{
+	std::unique_lock<std::mutex> lock( m_renderMutex );
+	m_renderDone.wait( lock, [this]() { return !m_bFramePending; } );
+}
+
+void PlayGraphics::StopRenderThread()
+{
+	if( !m_renderThread.joinable() )
+		return;
+
+	WaitForRenderThread();
+
+	{
+		std::lock_guard<std::mutex> lock( m_renderMutex );
+		m_bStopRenderThread = true;
+	}
+	m_renderStart.notify_one();
+
+	m_renderThread.join();
+	m_bStopRenderThread = false;
+}
+
+void PlayGraphics::InvalidateTiles()
+{
+	std::fill( m_vTileContents.begin(), m_vTileContents.end(), 0 );
+	std::fill( m_vTileChanged.begin(), m_vTileChanged.end(), 1 );
+}
+
+void PlayGraphics::GetChangedRows( int& top, int& bottom )
+{
+	int firstTile = static_cast<int>( std::find( m_vTileChanged.begin(), m_vTileChanged.end(), 1 ) - m_vTileChanged.begin() );
+	int lastTile = static_cast<int>( m_vTileChanged.rend() - std::find( m_vTileChanged.rbegin(), m_vTileChanged.rend(), 1 ) ) - 1;
+
+	if( firstTile > lastTile )
+	{
+		top = bottom = 0;
+		return;
+	}
+
+	top = ( firstTile / m_tileColumns ) * TILE_SIZE;
+	bottom = std::min( ( ( lastTile / m_tileColumns ) + 1 ) * TILE_SIZE, m_playBuffer.height );
+	std::fill( m_vTileChanged.begin(), m_vTileChanged.end(), 0 );
+}
+
+void PlayGraphics::RasterizeFrame()
+{
+	if( m_vRasterCommands.empty() )
+		return;
+
+	// Wake up the workers and help them with the tiles
+	m_nextTile = 0;
+	{
+		std::lock_guard<std::mutex> lock( m_workMutex );
+		m_workersBusy = static_cast<int>( m_vWorkers.size() );
+		m_workGeneration++;
+	}
+	m_workStart.notify_all();
+
+	RasterizeTiles();
+
+	// Wait for the workers to finish the tiles they're still working on
+	{
+		std::unique_lock<std::mutex> lock( m_workMutex );
+		m_workDone.wait( lock, [this]() { return m_workersBusy == 0; } );
+	}
+
+	m_vRasterCommands.clear();
+	for( std::vector<int>& bin : m_vRasterBins )
+		bin.clear();
+	m_bRasterReordered = false;
+}
+
+void PlayGraphics::RasterizeTiles()
+{
+	// Each thread uses its own blitter so that it can clip to the tile it's working on
+	PlayBlitter blitter( &m_playBuffer );
+	int totalTiles = static_cast<int>( m_vRasterBins.size() );
+
+	for( int tile = m_nextTile++; tile < totalTiles; tile = m_nextTile++ )
+	{
+		std::vector<int>& bin = m_vRasterBins[tile];
+
+		if( bin.empty() )
+			continue;
+
+		// Each tile is only worked on by one thread, so it can be sorted here rather than all at once
+		if( m_bRasterReordered )
+			std::sort( bin.begin(), bin.end(), [this]( int a, int b ) { return m_vRasterCommands[a].sortKey < m_vRasterCommands[b].sortKey; } );
+
+		// Nothing before the last command covering the whole tile can be seen, so drawing starts from there
+		size_t first = bin.size();
+		uint64_t coverKey = 0;
+		while( first > 0 && coverKey == 0 )
+			coverKey = GetCoverKey( m_vRasterCommands[bin[--first]] );
 
+		bool coveredLast = coverKey != 0 && first == bin.size() - 1;
 
+		// Restoring the background into a tile which nothing was drawn over last frame would leave it unchanged
+		if( coveredLast && m_vTileContents[tile] == coverKey )
+			continue;
 
+		int tileX = ( tile % m_tileColumns ) * TILE_SIZE;
+		int tileY = ( tile / m_tileColumns ) * TILE_SIZE;
+		blitter.SetClipRect( tileX, tileY, tileX + TILE_SIZE, tileY + TILE_SIZE );
 
-void PlayGraphics::DrawRect( Point2f topLeft, Point2f bottomRight, Pixel pix, bool fill )
-{
-	// Convert floating point co-ordinates to pixels
-	int x1 = static_cast<int>( topLeft.x + 0.5f );
-	int x2 = static_cast<int>( bottomRight.x + 0.5f );
-	int y1 = static_cast<int>( topLeft.y + 0.5f );
-	int y2 = static_cast<int>( bottomRight.y + 0.5f );
+		for( size_t i = first; i < bin.size(); i++ )
+			ExecuteDrawCommand( blitter, m_vRasterCommands[bin[i]] );
 
-	if( fill )
-	{
-		for( int x = x1; x < x2; x++ )
-		{
-			for( int y = y1; y < y2; y++ )
-				m_blitter.DrawPixel( x, y, pix );
-		}
-	}
-	else
-	{
-		m_blitter.DrawLine( x1, y1, x2, y1, pix );
-		m_blitter.DrawLine( x2, y1, x2, y2, pix );
-		m_blitter.DrawLine( x2, y2, x1, y2, pix );
-		m_blitter.DrawLine( x1, y2, x1, y1, pix );
+		m_vTileContents[tile] = coveredLast ? coverKey : 0;
+		m_vTileChanged[tile] = 1;
 	}
 }
 
-// Private function called by DrawCircle
-void PlayGraphics::DrawCircleOctants( int posX, int posY, int offX, int offY, Pixel pix )
+uint64_t PlayGraphics::GetCoverKey( const DrawCommand& command )
 {
-	DrawPixel( { posX + offX , posY + offY }, pix );
-	DrawPixel( { posX - offX , posY + offY }, pix );
-	DrawPixel( { posX + offX , posY - offY }, pix );
-	DrawPixel( { posX - offX , posY - offY }, pix );
-	DrawPixel( { posX - offY , posY + offX }, pix );
-	DrawPixel( { posX + offY , posY - offX }, pix );
-	DrawPixel( { posX - offY , posY - offX }, pix );
-	DrawPixel( { posX + offY , posY + offX }, pix );
+	switch( command.type )
+	{
+		case DrawCommand::DRAW_BACKGROUND:
+			// Background pixel data is aligned, so the key can't be confused with a clear's
+			return static_cast<uint64_t>( reinterpret_cast<uintptr_t>( command.source.pPixels ) );
+		case DrawCommand::DRAW_CLEAR:
+			return ( static_cast<uint64_t>( command.pix.bits ) << 1 ) | 1;
+		default:
+			return 0;
+	}
 }
 
-void PlayGraphics::DrawCircle( Point2f pos, int radius, Pixel pix )
+void PlayGraphics::RasterizeWorker( int workGeneration )
 {
-	// Convert floating point co-ordinates to pixels
-	int x = static_cast<int>( pos.x + 0.5f );
-	int y = static_cast<int>( pos.y + 0.5f );
-
-	int dx = 0;
-	int dy = radius;
-
-	int d = 3 - 2 * radius;
-	DrawCircleOctants( x, y, dx, dy, pix );
-
-	while( dy >= dx )
+	while( true )
 	{
-		dx++;
-		if( d > 0 )
 		{
-			dy--;
-			d = static_cast<int>( d + 4 * ( dx - dy ) + 10 );
+			std::unique_lock<std::mutex> lock( m_workMutex );
+			m_workStart.wait( lock, [&]() { return m_bStopWorkers || m_workGeneration != workGeneration; } );
+
+			if( m_bStopWorkers )
+				return;
+
+			workGeneration = m_workGeneration;
 		}
-		else
+
+		RasterizeTiles();
+
 		{
-			d = static_cast<int>( d + 4 * dx + 6 );
+			std::lock_guard<std::mutex> lock( m_workMutex );
+			if( --m_workersBusy == 0 )
+				m_workDone.notify_one();
 		}
-		DrawCircleOctants( x, y, dx, dy, pix );
 	}
-};
+}
 
-void PlayGraphics::DrawPixelData( PixelData* pixelData, Point2f pos, float alpha )
+void PlayGraphics::StopWorkers()
 {
-	if( !pixelData->preMultiplied )
 	{
-		PreMultiplyAlpha( pixelData->pPixels, pixelData->pPixels, pixelData->width, pixelData->height, pixelData->width );
-		pixelData->preMultiplied = true;
+		std::lock_guard<std::mutex> lock( m_workMutex );
+		m_bStopWorkers = true;
 	}
-	m_blitter.BlitPixels( *pixelData, 0, static_cast<int>(pos.x), static_cast<int>(pos.y), pixelData->width, pixelData->height, alpha );
+	m_workStart.notify_all();
+
+	for( std::thread& worker : m_vWorkers )
+		worker.join();
+
+	m_vWorkers.clear();
+	m_bStopWorkers = false;
 }
 
 
@@ -3142,13 +6146,24 @@ int PlayGraphics::DrawDebugCharacter( Point2f pos, char c, Pixel pix )
 	int sourceX = ( ( c - 0x30 ) % 16 ) * FONT_CHAR_WIDTH;
 	int sourceY = ( ( c - 0x30 ) / 16 ) * FONT_CHAR_HEIGHT;
 
-	// Loop over the bounding box of the glyph
-	for( int x = 0; x < FONT_CHAR_WIDTH; x++ )
+	// Draw each run of set pixels in the rows of the glyph as a single rectangle
+	int destX = static_cast<int>( pos.x + 0.5f );
+	int destY = static_cast<int>( pos.y + 0.5f );
+
+	for( int y = 0; y < FONT_CHAR_HEIGHT; y++ )
 	{
-		for( int y = 0; y < FONT_CHAR_HEIGHT; y++ )
+		const uint8_t* pRow = m_pDebugFontBuffer + ( ( sourceY + y ) * FONT_IMAGE_WIDTH ) + sourceX;
+
+		for( int x = 0; x < FONT_CHAR_WIDTH; x++ )
 		{
-			if( m_pDebugFontBuffer[( ( sourceY + y ) * FONT_IMAGE_WIDTH ) + ( sourceX + x )] > 0 )
-				DrawPixel( { pos.x + x, pos.y + y }, pix );
+			if( pRow[x] == 0 )
+				continue;
+
+			int runStart = x;
+			while( x < FONT_CHAR_WIDTH && pRow[x] > 0 )
+				x++;
+
+			DrawRect( { destX + runStart, destY + y }, { destX + x, destY + y + 1 }, pix, true );
 		}
 	}
 
@@ -3181,19 +6196,16 @@ int PlayGraphics::GetDebugStringWidth( const std::string& s )
 // Timing bar functions
 //********************************************************************************************************************************
 
-LARGE_INTEGER PlayGraphics::EndTimingSegment()
+long long PlayGraphics::EndTimingSegment()
 {
 	int size = static_cast<int>( m_vTimings.size() );
 
-	LARGE_INTEGER now, freq;
-	QueryPerformanceCounter( &now );
-	QueryPerformanceFrequency( &freq );
+	long long now = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
 
 	if( size > 0 )
 	{
-		m_vTimings[size - 1].end = now.QuadPart;
-		m_vTimings[size - 1].millisecs = static_cast<float>( m_vTimings[size - 1].end - m_vTimings[size - 1].begin );
-		m_vTimings[size - 1].millisecs = static_cast<float>( ( m_vTimings[size - 1].millisecs * 1000.0f ) / freq.QuadPart );
+		m_vTimings[size - 1].end = now;
+		m_vTimings[size - 1].millisecs = static_cast<float>( ( m_vTimings[size - 1].end - m_vTimings[size - 1].begin ) / 1000000.0 );
 	}
 
 	return now;
@@ -3203,7 +6215,7 @@ int PlayGraphics::SetTimingBarColour( Pixel pix )
 {
 	TimingSegment newData;
 	newData.pix = pix;
-	newData.begin = EndTimingSegment().QuadPart;
+	newData.begin = EndTimingSegment();
 
 	m_vTimings.push_back( newData );
 
@@ -3240,6 +6252,106 @@ void PlayGraphics::TimingBarBegin( Pixel pix )
 	m_vTimings.clear();
 	SetTimingBarColour( pix );
 }
+//********************************************************************************************************************************
+// File:		PlayParticles.cpp
+// Description:	Simulates and draws large numbers of short-lived sprites without using GameObjects
+// Platform:	Independent
+//********************************************************************************************************************************
+
+ParticleEmitter::ParticleEmitter( const ParticleSettings& settings, int capacity )
+	: m_settings( settings ), m_capacity( capacity )
+{
+	PLAY_ASSERT_MSG( capacity > 0, "A particle emitter needs space for at least one particle!" );
+
+	// All of the storage is allocated up front, so emitting and updating particles never allocates
+	for( std::vector<float>* pArray : { &m_posX, &m_posY, &m_velX, &m_velY, &m_age, &m_drawX, &m_drawY, &m_drawScale, &m_drawAlpha } )
+		pArray->resize( capacity );
+}
+
+void ParticleEmitter::Emit( Point2f pos, int count )
+{
+	auto randomUnit = []() { return static_cast<float>( rand() ) / RAND_MAX; };
+
+	for( int n = 0; n < count; n++ )
+	{
+		// A full ring buffer drops its oldest particle to make room
+		if( m_count == m_capacity )
+		{
+			m_first = ( m_first + 1 ) % m_capacity;
+			m_count--;
+		}
+
+		int i = ( m_first + m_count ) % m_capacity;
+		m_count++;
+
+		m_posX[i] = pos.x + m_settings.spread.x * ( ( randomUnit() * 2.0f ) - 1.0f );
+		m_posY[i] = pos.y + m_settings.spread.y * ( ( randomUnit() * 2.0f ) - 1.0f );
+		m_velX[i] = m_settings.velocity.x;
+		m_velY[i] = m_settings.velocity.y;
+		m_age[i] = 0.0f;
+
+		if( m_settings.burstSpeed > 0.0f )
+		{
+			float direction = randomUnit() * 2.0f * PLAY_PI;
+			float speed = randomUnit() * m_settings.burstSpeed;
+			m_velX[i] += cosf( direction ) * speed;
+			m_velY[i] += sinf( direction ) * speed;
+		}
+	}
+}
+
+void ParticleEmitter::Update( float elapsedTime )
+{
+	const Vector2f acceleration = m_settings.acceleration * elapsedTime;
+
+	// Each property is updated in its own pass over contiguous floats, which the compiler can vectorize
+	ForEachRange( [&]( int begin, int end )
+	{
+		for( int i = begin; i < end; i++ )
+		{
+			m_velX[i] += acceleration.x;
+			m_velY[i] += acceleration.y;
+		}
+		for( int i = begin; i < end; i++ )
+		{
+			m_posX[i] += m_velX[i] * elapsedTime;
+			m_posY[i] += m_velY[i] * elapsedTime;
+		}
+		for( int i = begin; i < end; i++ )
+			m_age[i] += elapsedTime;
+	} );
+
+	// Every particle has the same lifetime, so the expired ones are always the oldest
+	while( m_count > 0 && m_age[m_first] >= m_settings.lifetime )
+	{
+		m_first = ( m_first + 1 ) % m_capacity;
+		m_count--;
+	}
+}
+
+void ParticleEmitter::Draw() const
+{
+	if( m_count == 0 )
+		return;
+
+	const float ageToTime = 1.0f / m_settings.lifetime;
+	int n = 0;
+
+	ForEachRange( [&]( int begin, int end )
+	{
+		for( int i = begin; i < end; i++, n++ )
+		{
+			float t = std::min( m_age[i] * ageToTime, 1.0f );
+			m_drawX[n] = m_posX[i];
+			m_drawY[n] = m_posY[i];
+			m_drawScale[n] = m_settings.scale.Evaluate( t );
+			m_drawAlpha[n] = m_settings.alpha.Evaluate( t );
+		}
+	} );
+
+	PlayGraphics::Instance().DrawInstances( m_settings.spriteId, m_settings.frameIndex, m_count, m_drawX.data(), m_drawY.data(), m_drawScale.data(), m_drawAlpha.data(), m_settings.tint, m_settings.blendMode );
+}
+
 //********************************************************************************************************************************
 // File:		PlaySpeaker.cpp
 // Description:	Implementation of a very simple audio manager using the MCI
@@ -3250,21 +6362,34 @@ void PlayGraphics::TimingBarBegin( Pixel pix )
 //********************************************************************************************************************************
 
 
+#ifndef PLAY_HEADLESS
 // Instruct Visual Studio to link the multimedia library  
 #pragma comment(lib, "winmm.lib")
+#endif
 
 PlayAudio* PlayAudio::s_pInstance = nullptr;
 
+// Sends a command string to the MCI, or does nothing in headless builds where the audio is silent
+static void SendAudioCommand( const std::string& command )
+{
+#ifndef PLAY_HEADLESS
+	mciSendStringA( command.c_str(), NULL, 0, 0 );
+#else
+	UNREFERENCED_PARAMETER( command );
+#endif
+}
+
 //********************************************************************************************************************************
 // Constructor and destructor (private)
 //********************************************************************************************************************************
 PlayAudio::PlayAudio( const char* path )
 {
 	PLAY_ASSERT_MSG( !s_pInstance, "PlayAudio is a singleton class: multiple instances not allowed!" );
-	PLAY_ASSERT_MSG( std::filesystem::is_directory( path ), "Audio directory does not exist!" );
+	std::string nativePath = PlayNativePath( path );
+	PLAY_ASSERT_MSG( std::filesystem::is_directory( nativePath ), "Audio directory does not exist!" );
 
 	// Iterate through the directory
-	for( auto& p : std::filesystem::directory_iterator( path ) )
+	for( auto& p : std::filesystem::directory_iterator( nativePath ) )
 	{
 		// Switch everything to uppercase to avoid need to check case each time
 		std::string filename = p.path().string();
@@ -3275,7 +6400,7 @@ PlayAudio::PlayAudio( const char* path )
 		{
 			vSoundStrings.push_back( filename );
 			std::string command = "open \"" + filename + "\" type mpegvideo alias " + filename;
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
+			SendAudioCommand( command );
 		}
 	}
 
@@ -3287,7 +6412,7 @@ PlayAudio::~PlayAudio( void )
 	for( std::string& s : vSoundStrings )
 	{
 		std::string command = "close " + s;
-		mciSendStringA( command.c_str(), NULL, 0, 0 );
+		SendAudioCommand( command );
 	}
 
 	s_pInstance = nullptr;
@@ -3332,7 +6457,7 @@ void PlayAudio::StartAudio( const char* name, bool bLoop )
 		{
 			std::string command = "play " + s + " from 0";
 			if( bLoop ) command += " repeat";
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
+			SendAudioCommand( command );
 			return;
 		}
 	}
@@ -3350,7 +6475,7 @@ void PlayAudio::StopAudio( const char* name )
 		if( s.find( filename ) != std::string::npos )
 		{
 			std::string command = "stop " + s;
-			mciSendStringA( command.c_str(), NULL, 0, 0 );
+			SendAudioCommand( command );
 			return;
 		}
 	}
@@ -3364,111 +6489,473 @@ void PlayAudio::StopAudio( const char* name )
 //********************************************************************************************************************************
 
 
-PlayInput* PlayInput::s_pInstance = nullptr;
+PlayInput* PlayInput::s_pInstance = nullptr;
+
+//********************************************************************************************************************************
+// Constructor and destructor (private)
+//********************************************************************************************************************************
+PlayInput::PlayInput( void )
+{
+	PLAY_ASSERT_MSG( !s_pInstance, "PlayInput is a singleton class: multiple instances not allowed!" );
+	s_pInstance = this;
+}
+
+PlayInput::~PlayInput( void )
+{
+	s_pInstance = nullptr;
+}
+
+//********************************************************************************************************************************
+// Instance access functions
+//********************************************************************************************************************************
+
+PlayInput& PlayInput::Instance()
+{
+	if( !s_pInstance )
+		s_pInstance = new PlayInput();
+
+	return *s_pInstance;
+}
+
+void PlayInput::Destroy()
+{
+	if( s_pInstance )
+		delete s_pInstance;
+}
+
+//********************************************************************************************************************************
+// Mouse functions
+//********************************************************************************************************************************
+
+bool PlayInput::GetMouseDown( MouseButton button ) const
+{
+	PLAY_ASSERT_MSG( button == BUTTON_LEFT || button == BUTTON_RIGHT, "Invalid mouse button selected." );
+
+	if( button == BUTTON_LEFT )
+		return m_mouseData.left;
+	else
+		return m_mouseData.right;
+};
+
+bool PlayInput::KeyPressed( int vKey )
+{
+	static std::map< int, bool > keyMap;
+
+	bool& held = keyMap[vKey];
+
+	if( KeyDown( vKey ) && !held )
+	{
+		held = true;
+		return true;
+	}
+
+	if( !KeyDown( vKey ) )
+		held = false;
+
+	return false;
+}
+
+bool PlayInput::KeyDown( int vKey )
+{
+#ifndef PLAY_HEADLESS
+	return GetAsyncKeyState( vKey ) & 0x8000; // Don't want multiple calls to KeyState
+#else
+	return PlayWindow::Instance().IsKeyDown( vKey );
+#endif
+}
+//********************************************************************************************************************************
+// File:		PlayManager.cpp
+// Description:	A manager for providing simplified access to the PlayBuffer framework
+// Platform:	Independent
+// Notes:		The GameObject management is "opt in" as many will want to create their own GameObject class
+//********************************************************************************************************************************
+
+//**************************************************************************************************
+// GameObject Class Definition
+//**************************************************************************************************
+
+// Define this to opt in to the PlayManager
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+
+// Constructor for the GameObject struct - kept as simple as possible
+// > The id is allocated by the PlayManager when it creates the object
+GameObject::GameObject( int type, Point2f newPos, int collisionRadius, int spriteId, int id )
+	: type( type ), pos( newPos ), radius( collisionRadius ), spriteId( spriteId ), m_id( id )
+{
+	// Member variables are assigned default values in the class header
+}
+
+#endif
+
+// The PlayManager is namespace rather than a class
+namespace Play
+{
+	// The particle emitters, indexed by their ids (a deque so that creating one doesn't move the others)
+	static std::deque<ParticleEmitter> particleEmitters;
+
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+
+	// A generational slot map is used internally to store all the GameObjects and their unique ids
+	// > An id is a slot index plus the generation of that slot, which is increased every time an object in the slot is
+	//   destroyed. Looking up an id is O(1) and the id of a destroyed object never finds whichever object reuses its slot.
+	// > The objects are also packed into a dense array (in no particular order) so iterating over them is fast
+	constexpr int OBJECT_INDEX_BITS = 20;
+	constexpr int OBJECT_INDEX_MASK = ( 1 << OBJECT_INDEX_BITS ) - 1;
+	constexpr int OBJECT_GENERATION_MASK = 0x7FF; // Keeps the ids positive
+
+	struct ObjectSlot
+	{
+		int generation{ 0 }; // Increased each time the slot's object is destroyed
+		int denseIndex{ -1 }; // The object's position in the dense arrays, or -1 if the slot is free
+		int nextFree{ -1 }; // The next slot in the free list
+		int bucketType{ -1 }; // The type bucket the object is in
+		int bucketIndex{ -1 }; // The object's position in its type bucket
+		unsigned int creationOrder{ 0 }; // Increases with every object created, so objects can be listed in creation order
+		int gridBucket{ -1 }; // The collision grid bucket the object is in, or -1 if it hasn't been added yet
+		int gridIndex{ -1 }; // The object's position in its collision grid bucket
+		bool gridPending{ false }; // Set when the object has been created or moved directly since its collision grid bucket was last checked
+		bool interpolate{ false }; // Set once the object has been updated, so its oldPos and oldRot can be drawn from
+	};
+
+	static std::vector<ObjectSlot> objectSlots;
+	static std::vector<GameObject*> denseObjects;
+	static std::vector<int> denseObjectIds;
+	// Free slots are reused oldest first, so churn doesn't keep cycling the generation of a single slot
+	static int firstFreeSlot{ -1 };
+	static int lastFreeSlot{ -1 };
+
+	// The ids of the GameObjects of each type in the order they were created or given the type, indexed by type, so type
+	//   queries only visit matching objects
+	// > Removing an object leaves a hole (-1) so the order is kept without moving the rest of the bucket, and the holes are
+	//   closed up the next time the bucket is read, so adding, removing and changing type are all O(1)
+	struct TypeBucket
+	{
+		std::vector<int> ids;
+		int holes{ 0 };
+	};
+
+	static std::vector<TypeBucket> typeBuckets;
+	static unsigned int nextCreationOrder{ 0 };
+
+	// GameObjects are constructed in place in fixed-size blocks of storage indexed by slot, so the slot free list is also the
+	// storage free list and creating or destroying an object doesn't touch the heap unless a new block is needed
+	// > Each object starts on its own cache line
+	constexpr int OBJECT_BLOCK_BITS = 8;
+	constexpr int OBJECT_BLOCK_SIZE = 1 << OBJECT_BLOCK_BITS;
+	constexpr size_t CACHE_LINE_SIZE = 64;
+
+	struct alignas( CACHE_LINE_SIZE ) ObjectStorage
+	{
+		unsigned char bytes[sizeof( GameObject )];
+	};
+
+	// The blocks are never resized, so the objects in them never move
+	static std::vector<std::vector<ObjectStorage>> objectBlocks;
+
+	// Adds storage blocks until there is room for the given number of slots
+	static void ReserveObjectStorage( int slotCount )
+	{
+		while( static_cast<int>( objectBlocks.size() ) * OBJECT_BLOCK_SIZE < slotCount )
+			objectBlocks.emplace_back( OBJECT_BLOCK_SIZE );
+	}
+
+	// Gets the storage for the object in the given slot
+	static void* GetObjectStorage( int index )
+	{
+		return objectBlocks[index >> OBJECT_BLOCK_BITS][index & ( OBJECT_BLOCK_SIZE - 1 )].bytes;
+	}
+
+	// Used instead of Null return values, PlayMangager operations performed on this GameObject should fail transparently
+	static GameObject noObject{ -1,{ 0, 0 }, 0, -1 };
+
+	// Closes up the holes left in a type bucket by removed objects, keeping the order of the rest
+	static void CompactTypeBucket( TypeBucket& bucket )
+	{
+		if( bucket.holes == 0 )
+			return;
+
+		int count = 0;
+		for( int id : bucket.ids )
+		{
+			if( id < 0 ) continue;
+			objectSlots[id & OBJECT_INDEX_MASK].bucketIndex = count;
+			bucket.ids[count++] = id;
+		}
+
+		bucket.ids.resize( count );
+		bucket.holes = 0;
+	}
+
+	// Adds an object to the end of the bucket for the given type
+	static void AddToTypeBucket( int id, int type )
+	{
+		PLAY_ASSERT_MSG( type >= 0, "GameObject types can't be negative" );
+
+		if( type >= static_cast<int>( typeBuckets.size() ) )
+			typeBuckets.resize( static_cast<size_t>( type ) + 1 );
+
+		TypeBucket& bucket = typeBuckets[type];
+		ObjectSlot& slot = objectSlots[id & OBJECT_INDEX_MASK];
+		slot.bucketType = type;
+
+		// Buckets which are changed but never read would otherwise keep growing, but closing the holes once they make up half
+		// the bucket still only costs O(1) for each object added
+		if( bucket.holes * 2 > static_cast<int>( bucket.ids.size() ) )
+			CompactTypeBucket( bucket );
+
+		slot.bucketIndex = static_cast<int>( bucket.ids.size() );
+		bucket.ids.push_back( id );
+	}
+
+	// Removes an object from its type bucket, leaving a hole so the order of the other objects doesn't change
+	static void RemoveFromTypeBucket( int id )
+	{
+		ObjectSlot& slot = objectSlots[id & OBJECT_INDEX_MASK];
+		TypeBucket& bucket = typeBuckets[slot.bucketType];
+
+		bucket.ids[slot.bucketIndex] = -1;
+		bucket.holes++;
+
+		slot.bucketType = -1;
+		slot.bucketIndex = -1;
+	}
+
+	// Finds the GameObject with the given id
+	// > Returns nullptr if the id doesn't belong to an existing object
+	static GameObject* FindGameObject( int id )
+	{
+		int index = id & OBJECT_INDEX_MASK;
+
+		if( id < 0 || index >= static_cast<int>( objectSlots.size() ) )
+			return nullptr;
+
+		const ObjectSlot& slot = objectSlots[index];
+
+		if( slot.denseIndex < 0 || slot.generation != ( id >> OBJECT_INDEX_BITS ) )
+			return nullptr;
+
+		return denseObjects[slot.denseIndex];
+	}
+
+	constexpr int MIN_COLLISION_CELL_SIZE = 64;
+	constexpr unsigned int MIN_COLLISION_BUCKETS = 64;
+
+	// A uniform grid of the objects' positions for finding collisions without testing every pair of objects
+	// > The grid covers unlimited space by hashing the cells into a fixed number of buckets. Each object is stored in the
+	//   bucket for the cell containing its position and queries look in all of the cells that a collision could reach.
+	// > Updated objects are moved to their new bucket straight away if it's changed, while new objects and those moved
+	//   directly are added before the next query. The whole grid is only rebuilt when the cells or the number of buckets
+	//   have to grow.
+	struct CollisionGrid
+	{
+		int cellSize{ MIN_COLLISION_CELL_SIZE };
+		int maxRadius{ 0 }; // The largest collision radius of any object added since the manager was created
+		unsigned int bucketMask{ MIN_COLLISION_BUCKETS - 1 };
+		std::vector<std::vector<int>> buckets; // The slot indices of the objects in each bucket
+		std::vector<int> pending; // The slot indices of the objects created or moved directly since the last query
+		std::vector<unsigned int> visited; // Stops queries returning the same object twice, indexed by slot
+		unsigned int visitStamp{ 0 };
+	};
+
+	static CollisionGrid collisionGrid;
+	static std::vector<int> collisionResults;
+	static std::vector<int> collisionPairs;
+
+	// Fixed timestep state: the alpha stays at 1 so objects are drawn at their current position until fixed steps are used
+	constexpr int MAX_FIXED_STEPS_PER_FRAME = 5;
+	static float fixedTimeStep{ 1.0f / FRAMES_PER_SECOND };
+	static double fixedStepAccumulator{ 0.0 };
+	static float fixedStepAlpha{ 1.0f };
+
+	// Marks the object as having an oldPos and oldRot which can be used for drawing
+	static void SetInterpolate( GameObject& obj )
+	{
+		int id = obj.GetId();
+		if( id >= 0 )
+			objectSlots[id & OBJECT_INDEX_MASK].interpolate = true;
+	}
+
+	// Checks whether the object should be drawn between its old and current state
+	static bool IsInterpolated( GameObject& obj )
+	{
+		int id = obj.GetId();
+		return fixedStepAlpha < 1.0f && id >= 0 && objectSlots[id & OBJECT_INDEX_MASK].interpolate;
+	}
+
+	static Point2f GetDrawPosition( GameObject& obj )
+	{
+		return IsInterpolated( obj ) ? obj.oldPos + ( obj.pos - obj.oldPos ) * fixedStepAlpha : obj.pos;
+	}
+
+	static int CollisionCell( float position, int cellSize )
+	{
+		return static_cast<int>( floor( position / cellSize ) );
+	}
+
+	static unsigned int CollisionBucket( int cellX, int cellY, unsigned int bucketMask )
+	{
+		return ( ( static_cast<unsigned int>( cellX ) * 73856093u ) ^ ( static_cast<unsigned int>( cellY ) * 19349663u ) ) & bucketMask;
+	}
 
-//********************************************************************************************************************************
-// Constructor and destructor (private)
-//********************************************************************************************************************************
-PlayInput::PlayInput( void )
-{
-	PLAY_ASSERT_MSG( !s_pInstance, "PlayInput is a singleton class: multiple instances not allowed!" );
-	s_pInstance = this;
-}
+	// Gets the bucket for the cell containing the object's position
+	static unsigned int CollisionBucket( const GameObject& obj )
+	{
+		const CollisionGrid& grid = collisionGrid;
+		return CollisionBucket( CollisionCell( obj.pos.x, grid.cellSize ), CollisionCell( obj.pos.y, grid.cellSize ), grid.bucketMask );
+	}
 
-PlayInput::~PlayInput( void )
-{
-	s_pInstance = nullptr;
-}
+	// Adds an object to the end of a collision grid bucket
+	static void AddToCollisionGrid( int index, unsigned int bucket )
+	{
+		std::vector<int>& ids = collisionGrid.buckets[bucket];
+		ObjectSlot& slot = objectSlots[index];
+		slot.gridBucket = static_cast<int>( bucket );
+		slot.gridIndex = static_cast<int>( ids.size() );
+		ids.push_back( index );
+	}
 
-//********************************************************************************************************************************
-// Instance access functions
-//********************************************************************************************************************************
+	// Removes an object from its collision grid bucket by moving the bucket's last object into its place
+	static void RemoveFromCollisionGrid( int index )
+	{
+		ObjectSlot& slot = objectSlots[index];
+		if( slot.gridBucket < 0 )
+			return;
 
-PlayInput& PlayInput::Instance()
-{
-	if( !s_pInstance )
-		s_pInstance = new PlayInput();
+		std::vector<int>& ids = collisionGrid.buckets[slot.gridBucket];
+		ids[slot.gridIndex] = ids.back();
+		objectSlots[ids.back()].gridIndex = slot.gridIndex;
+		ids.pop_back();
 
-	return *s_pInstance;
-}
+		slot.gridBucket = -1;
+		slot.gridIndex = -1;
+	}
 
-void PlayInput::Destroy()
-{
-	if( s_pInstance )
-		delete s_pInstance;
-}
+	// Moves an object which has been updated into the bucket for its new position, if it's changed
+	static void MoveInCollisionGrid( int id, const GameObject& obj )
+	{
+		if( id < 0 )
+			return;
 
-//********************************************************************************************************************************
-// Mouse functions
-//********************************************************************************************************************************
+		int index = id & OBJECT_INDEX_MASK;
+		const ObjectSlot& slot = objectSlots[index];
+		if( slot.gridPending || slot.gridBucket < 0 )
+			return; // The next query will add it
 
-bool PlayInput::GetMouseDown( MouseButton button ) const
-{
-	PLAY_ASSERT_MSG( button == BUTTON_LEFT || button == BUTTON_RIGHT, "Invalid mouse button selected." );
+		unsigned int bucket = CollisionBucket( obj );
+		if( slot.gridBucket != static_cast<int>( bucket ) )
+		{
+			RemoveFromCollisionGrid( index );
+			AddToCollisionGrid( index, bucket );
+		}
+	}
 
-	if( button == BUTTON_LEFT )
-		return m_mouseData.left;
-	else
-		return m_mouseData.right;
-};
+	// Makes the next query check which bucket the object should be in
+	static void MarkCollisionGridPending( int id )
+	{
+		if( id < 0 )
+			return;
 
-bool PlayInput::KeyPressed( int vKey )
-{
-	static std::map< int, bool > keyMap;
+		ObjectSlot& slot = objectSlots[id & OBJECT_INDEX_MASK];
+		if( slot.gridPending )
+			return;
 
-	bool& held = keyMap[vKey];
+		slot.gridPending = true;
+		collisionGrid.pending.push_back( id & OBJECT_INDEX_MASK );
+	}
 
-	if( KeyDown( vKey ) && !held )
+	// Adds the new objects and moves those moved directly into their new buckets, rebuilding the whole grid if it has to grow
+	static void UpdateCollisionGrid()
 	{
-		held = true;
-		return true;
-	}
+		CollisionGrid& grid = collisionGrid;
+		if( grid.buckets.empty() )
+			grid.buckets.resize( grid.bucketMask + 1 );
 
-	if( !KeyDown( vKey ) )
-		held = false;
+		for( int index : grid.pending )
+		{
+			ObjectSlot& slot = objectSlots[index];
+			if( !slot.gridPending )
+				continue; // Destroyed, or already checked
 
-	return false;
-}
+			slot.gridPending = false;
+			const GameObject& obj = *denseObjects[slot.denseIndex];
+			grid.maxRadius = std::max( grid.maxRadius, obj.radius );
 
-bool PlayInput::KeyDown( int vKey )
-{
-	return GetAsyncKeyState( vKey ) & 0x8000; // Don't want multiple calls to KeyState
-}
-//********************************************************************************************************************************
-// File:		PlayManager.cpp
-// Description:	A manager for providing simplified access to the PlayBuffer framework
-// Platform:	Independent
-// Notes:		The GameObject management is "opt in" as many will want to create their own GameObject class
-//********************************************************************************************************************************
+			unsigned int bucket = CollisionBucket( obj );
+			if( slot.gridBucket != static_cast<int>( bucket ) )
+			{
+				RemoveFromCollisionGrid( index );
+				AddToCollisionGrid( index, bucket );
+			}
+		}
+		grid.pending.clear();
 
-//**************************************************************************************************
-// GameObject Class Definition
-//**************************************************************************************************
+		if( grid.visited.size() < objectSlots.size() )
+			grid.visited.resize( objectSlots.size(), 0 );
 
-// Define this to opt in to the PlayManager
-#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+		// The cells are kept big enough that a query only needs to look at the neighbouring cells for typical objects, and
+		// there are enough buckets that few cells share one
+		int cellSize = std::max( MIN_COLLISION_CELL_SIZE, grid.maxRadius * 2 );
+		unsigned int bucketCount = grid.bucketMask + 1;
+		while( bucketCount < static_cast<unsigned int>( denseObjects.size() ) * 2 )
+			bucketCount *= 2;
 
-// Constructor for the GameObject struct - kept as simple as possible
-GameObject::GameObject( int type, Point2f newPos, int collisionRadius, int spriteId = 0 )
-	: type( type ), pos( newPos ), radius( collisionRadius ), spriteId( spriteId )
-{
-	// Member variables are assigned default values in the class header
-	static int uniqueId = 0;
-	m_id = uniqueId++;
-}
+		if( cellSize == grid.cellSize && bucketCount == grid.bucketMask + 1 )
+			return;
 
-#endif
+		grid.cellSize = cellSize;
+		grid.bucketMask = bucketCount - 1;
+		for( std::vector<int>& ids : grid.buckets )
+			ids.clear();
+		grid.buckets.resize( bucketCount );
 
-// The PlayManager is namespace rather than a class
-namespace Play
-{
-#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+		for( size_t i = 0; i < denseObjects.size(); i++ )
+			AddToCollisionGrid( denseObjectIds[i] & OBJECT_INDEX_MASK, CollisionBucket( *denseObjects[i] ) );
+	}
 
-	// A map is used internally to store all the GameObjects and their unique ids
-	static std::map<int, GameObject&> objectMap;
+	// Calls visit( denseIndex ) once for every object close enough that it might collide with the given object
+	template< typename Visit > static void VisitCollisionCandidates( const GameObject& obj, Visit visit )
+	{
+		CollisionGrid& grid = collisionGrid;
 
-	// Used instead of Null return values, PlayMangager operations performed on this GameObject should fail transparently
-	static GameObject noObject{ -1,{ 0, 0 }, 0, -1 };
+		if( ++grid.visitStamp == 0 )
+		{
+			std::fill( grid.visited.begin(), grid.visited.end(), 0 );
+			grid.visitStamp = 1;
+		}
+
+		// IsColliding() truncates the positions, which can bring objects up to a pixel closer on each axis
+		float reach = static_cast<float>( obj.radius + grid.maxRadius + 2 );
+		int minCellX = CollisionCell( obj.pos.x - reach, grid.cellSize );
+		int maxCellX = CollisionCell( obj.pos.x + reach, grid.cellSize );
+		int minCellY = CollisionCell( obj.pos.y - reach, grid.cellSize );
+		int maxCellY = CollisionCell( obj.pos.y + reach, grid.cellSize );
+
+		for( int cellY = minCellY; cellY <= maxCellY; cellY++ )
+		{
+			for( int cellX = minCellX; cellX <= maxCellX; cellX++ )
+			{
+				unsigned int bucket = CollisionBucket( cellX, cellY, grid.bucketMask );
+				for( int index : grid.buckets[bucket] )
+				{
+					if( grid.visited[index] == grid.visitStamp )
+						continue;
+
+					grid.visited[index] = grid.visitStamp;
+					const ObjectSlot& slot = objectSlots[index];
+#ifdef _DEBUG
+					PLAY_ASSERT_MSG( CollisionBucket( *denseObjects[slot.denseIndex] ) == bucket && denseObjects[slot.denseIndex]->radius <= grid.maxRadius,
+						"GameObject moved directly since the last update: call Play::MarkGameObjectMoved() after changing its position or radius" );
+#endif
+					visit( slot.denseIndex );
+				}
+			}
+		}
+	}
+
+	static bool IsTypeInMask( int type, unsigned int typeMask )
+	{
+		return type >= 0 && type < 32 && ( typeMask & ( 1u << type ) ) != 0;
+	}
 
 #endif 
 
@@ -3488,14 +6975,28 @@ namespace Play
 	// Manager creation and deletion
 	//**************************************************************************************************
 
-	void CreateManager( int displayWidth, int displayHeight, int displayScale )
+	void CreateManager( int displayWidth, int displayHeight, int displayScale, int reserveGameObjects )
 	{
 		PlayGraphics::Instance( displayWidth, displayHeight, "Data\\Sprites\\" );
 		PlayWindow::Instance( PlayGraphics::Instance().GetDrawingBuffer(), displayScale );
 		PlayWindow::Instance().RegisterMouse( PlayInput::Instance().GetMouseData() );
 		PlayAudio::Instance( "Data\\Audio\\" );
+#ifndef PLAY_HEADLESS
 		// Seed the game's random number generator based on the time
 		srand( (int)time( NULL ) );
+#else
+		// Headless runs use a fixed seed so they can be repeated exactly
+		srand( 0 );
+#endif
+#ifdef PLAY_USING_GAMEOBJECT_MANAGER
+		PLAY_ASSERT_MSG( reserveGameObjects <= OBJECT_INDEX_MASK + 1, "Too many GameObjects!" );
+		ReserveObjectStorage( reserveGameObjects );
+		objectSlots.reserve( reserveGameObjects );
+		denseObjects.reserve( reserveGameObjects );
+		denseObjectIds.reserve( reserveGameObjects );
+#else
+		UNREFERENCED_PARAMETER( reserveGameObjects );
+#endif
 	}
 
 	void DestroyManager()
@@ -3504,10 +7005,22 @@ namespace Play
 		PlayGraphics::Destroy();
 		PlayWindow::Destroy();
 		PlayInput::Destroy();
+		particleEmitters.clear();
 #ifdef PLAY_USING_GAMEOBJECT_MANAGER
-		for( std::pair<const int, GameObject&>& p : objectMap )
-			delete& p.second;
-		objectMap.clear();
+		for( GameObject* pObj : denseObjects )
+			pObj->~GameObject();
+		denseObjects.clear();
+		denseObjectIds.clear();
+		objectSlots.clear();
+		typeBuckets.clear();
+		nextCreationOrder = 0;
+		objectBlocks.clear();
+		collisionGrid = {};
+		collisionResults.clear();
+		collisionPairs.clear();
+		fixedStepAccumulator = 0.0;
+		fixedStepAlpha = 1.0f;
+		firstFreeSlot = lastFreeSlot = -1;
 #endif
 	}
 
@@ -3521,6 +7034,11 @@ namespace Play
 		return PlayWindow::Instance().GetHeight();
 	}
 
+	void SetFrameRate( int framesPerSecond )
+	{
+		PlayWindow::Instance().SetTargetFrameRate( framesPerSecond );
+	}
+
 	//**************************************************************************************************
 	// PlayGraphics functions
 	//**************************************************************************************************
@@ -3548,6 +7066,21 @@ namespace Play
 		PlayGraphics::Instance().DrawDebugString( pos, text, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }, centred );
 	}
 
+	void SetDeferredDrawing( bool deferred )
+	{
+		PlayGraphics::Instance().SetDeferredDrawing( deferred );
+	}
+
+	void SetPipelinedDrawing( bool pipelined )
+	{
+		PlayGraphics::Instance().SetPipelinedDrawing( pipelined );
+	}
+
+	void SetDrawingLayer( int layer, bool sortBySprite )
+	{
+		PlayGraphics::Instance().SetDrawingLayer( layer, sortBySprite );
+	}
+
 	void PresentDrawingBuffer()
 	{
 		PlayGraphics& pblt = PlayGraphics::Instance();
@@ -3569,9 +7102,9 @@ namespace Play
 
 #ifdef PLAY_USING_GAMEOBJECT_MANAGER
 			
-			for( std::pair<const int, GameObject&>& i : objectMap )
+			for( GameObject* pObj : denseObjects )
 			{
-				GameObject& obj = i.second;
+				GameObject& obj = *pObj;
 				int id = obj.spriteId;
 				Vector2D size = pblt.GetSpriteSize( obj.spriteId );
 				Vector2D origin = pblt.GetSpriteOrigin( id );
@@ -3598,7 +7131,7 @@ namespace Play
 #endif
 		}
 
-		PlayWindow::Instance().Present();
+		pblt.PresentFrame( []( int top, int bottom ) { PlayWindow::Instance().Present( top, bottom ); } );
 	}
 
 	Point2D GetMousePos()
@@ -3773,6 +7306,16 @@ namespace Play
 		PlayGraphics::Instance().DrawRotated( spriteID, pos, frameIndex, angle, scale, opacity );
 	}
 
+	void DrawSpriteTinted( const char* spriteName, Point2D pos, int frameIndex, Colour tint, float opacity )
+	{
+		DrawSpriteTinted( PlayGraphics::Instance().GetSpriteId( spriteName ), pos, frameIndex, tint, opacity );
+	}
+
+	void DrawSpriteTinted( int spriteID, Point2D pos, int frameIndex, Colour tint, float opacity )
+	{
+		PlayGraphics::Instance().DrawTransparent( spriteID, pos, frameIndex, opacity, { tint.red * 2.55f, tint.green * 2.55f, tint.blue * 2.55f } );
+	}
+
 	void DrawLine( Point2f start, Point2f end, Colour c )
 	{
 		return PlayGraphics::Instance().DrawLine( start, end, { c.red * 2.55f, c.green * 2.55f, c.blue * 2.55f }  );
@@ -3791,7 +7334,6 @@ namespace Play
 	void DrawSpriteLine( Point2f startPos, Point2f endPos, const char* penSprite, Colour c )
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( penSprite );
-		ColourSprite( penSprite, c );
 
 		//Draws a line in any angle
 		int x1 = static_cast<int>( startPos.x );
@@ -3814,7 +7356,7 @@ namespace Play
 
 		while( true )
 		{
-			Play::DrawSprite( spriteId, { x1, y1 }, 0 );
+			Play::DrawSpriteTinted( spriteId, { x1, y1 }, 0, c );
 			
 			if( x1 == x2 && y1 == y2 )
 				break;
@@ -3833,27 +7375,26 @@ namespace Play
 		}
 	}
 
-	void DrawCircleOctants( int spriteId, int x, int y, int ox, int oy )
+	void DrawCircleOctants( int spriteId, int x, int y, int ox, int oy, Colour c )
 	{
 		//displaying all 8 coordinates of(x,y) residing in 8-octants
-		Play::DrawSprite( spriteId, { x + ox, y + oy }, 0 );
-		Play::DrawSprite( spriteId, { x - ox, y + oy }, 0 );
-		Play::DrawSprite( spriteId, { x + ox, y - oy }, 0 );
-		Play::DrawSprite( spriteId, { x - ox, y - oy }, 0 );
-		Play::DrawSprite( spriteId, { x + oy, y + ox }, 0 );
-		Play::DrawSprite( spriteId, { x - oy, y + ox }, 0 );
-		Play::DrawSprite( spriteId, { x + oy, y - ox }, 0 );
-		Play::DrawSprite( spriteId, { x - oy, y - ox }, 0 );
+		Play::DrawSpriteTinted( spriteId, { x + ox, y + oy }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x - ox, y + oy }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x + ox, y - oy }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x - ox, y - oy }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x + oy, y + ox }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x - oy, y + ox }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x + oy, y - ox }, 0, c );
+		Play::DrawSpriteTinted( spriteId, { x - oy, y - ox }, 0, c );
 	}
 
 	void DrawSpriteCircle( int x, int y, int radius, const char* penSprite, Colour c )
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( penSprite );
-		ColourSprite( penSprite, c );
 
 		int ox = 0, oy = radius;
 		int d = 3 - 2 * radius;
-		DrawCircleOctants( spriteId, x, y, ox, oy );
+		DrawCircleOctants( spriteId, x, y, ox, oy, c );
 
 		while( oy >= ox )
 		{
@@ -3867,17 +7408,18 @@ namespace Play
 			{
 				d = d + 4 * ox + 6;
 			}
-			DrawCircleOctants( spriteId, x, y, ox, oy );
+			DrawCircleOctants( spriteId, x, y, ox, oy, c );
 		}
 	};
 
-	void DrawFontText( const char* fontId, std::string text, Point2D pos, Align justify )
+	void DrawFontText( const char* fontId, const std::string& text, Point2D pos, Align justify )
 	{
-		int font = PlayGraphics::Instance().GetSpriteId( fontId );
+		DrawFontText( PlayGraphics::Instance().GetSpriteId( fontId ), text, pos, justify );
+	}
 
-		int totalWidth{ 0 };
-		for( char c : text )
-			totalWidth += PlayGraphics::Instance().GetFontCharWidth( font, c );
+	void DrawFontText( int font, const std::string& text, Point2D pos, Align justify )
+	{
+		int totalWidth = MeasureText( font, text );
 
 		switch( justify )
 		{
@@ -3894,6 +7436,16 @@ namespace Play
 		PlayGraphics::Instance().DrawString( font, pos, text );
 	}
 
+	int MeasureText( const char* fontId, const std::string& text )
+	{
+		return MeasureText( PlayGraphics::Instance().GetSpriteId( fontId ), text );
+	}
+
+	int MeasureText( int fontId, const std::string& text )
+	{
+		return PlayGraphics::Instance().GetStringWidth( fontId, text );
+	}
+
 	void BeginTimingBar( Colour c )
 	{
 		PlayGraphics::Instance().TimingBarBegin( Pixel( c.red*2.55f, c.green*2.55f, c.blue*2.55f ) );
@@ -3909,6 +7461,57 @@ namespace Play
 		PlayGraphics::Instance().DrawTimingBar( pos, size );
 	}
 
+	//**************************************************************************************************
+	// Particle functions
+	//**************************************************************************************************
+
+	int CreateParticleEmitter( const char* spriteName, int capacity, const ParticleSettings& settings )
+	{
+		int spriteId = PlayGraphics::Instance().GetSpriteId( spriteName );
+		PLAY_ASSERT_MSG( spriteId >= 0, "Trying to create a particle emitter with a sprite which doesn't exist!" );
+
+		particleEmitters.emplace_back( settings, capacity );
+		particleEmitters.back().GetSettings().spriteId = spriteId;
+		return static_cast<int>( particleEmitters.size() ) - 1;
+	}
+
+	ParticleSettings& GetParticleSettings( int emitterId )
+	{
+		PLAY_ASSERT_MSG( emitterId >= 0 && emitterId < static_cast<int>( particleEmitters.size() ), "Invalid particle emitter id!" );
+		return particleEmitters[emitterId].GetSettings();
+	}
+
+	void EmitParticles( int emitterId, Point2f pos, int count )
+	{
+		PLAY_ASSERT_MSG( emitterId >= 0 && emitterId < static_cast<int>( particleEmitters.size() ), "Invalid particle emitter id!" );
+		particleEmitters[emitterId].Emit( pos, count );
+	}
+
+	void UpdateParticles( float elapsedTime )
+	{
+		for( ParticleEmitter& emitter : particleEmitters )
+			emitter.Update( elapsedTime );
+	}
+
+	void DrawParticles( int emitterId )
+	{
+		PLAY_ASSERT_MSG( emitterId >= 0 && emitterId < static_cast<int>( particleEmitters.size() ), "Invalid particle emitter id!" );
+		particleEmitters[emitterId].Draw();
+	}
+
+	void ClearParticles( int emitterId )
+	{
+		if( emitterId == -1 )
+		{
+			for( ParticleEmitter& emitter : particleEmitters )
+				emitter.Clear();
+			return;
+		}
+
+		PLAY_ASSERT_MSG( emitterId >= 0 && emitterId < static_cast<int>( particleEmitters.size() ), "Invalid particle emitter id!" );
+		particleEmitters[emitterId].Clear();
+	}
+
 
 	//**************************************************************************************************
 	// GameObject functions
@@ -3919,51 +7522,106 @@ namespace Play
 	int CreateGameObject( int type, Point2f newPos, int collisionRadius, const char* spriteName )
 	{
 		int spriteId = PlayGraphics::Instance().GetSpriteId( spriteName );
-		// Deletion is handled in DestroyGameObject()
-		GameObject* pObj = new GameObject( type, newPos, collisionRadius, spriteId );
-		int id = pObj->GetId();
-		objectMap.insert( std::map<int, GameObject&>::value_type( id, *pObj ) );
+
+		// Reuse a free slot if there is one
+		int index = firstFreeSlot;
+		if( index >= 0 )
+		{
+			firstFreeSlot = objectSlots[index].nextFree;
+			if( firstFreeSlot < 0 )
+				lastFreeSlot = -1;
+		}
+		else
+		{
+			index = static_cast<int>( objectSlots.size() );
+			PLAY_ASSERT_MSG( index <= OBJECT_INDEX_MASK, "Too many GameObjects!" );
+			objectSlots.emplace_back();
+			ReserveObjectStorage( index + 1 );
+		}
+
+		ObjectSlot& slot = objectSlots[index];
+		int id = ( slot.generation << OBJECT_INDEX_BITS ) | index;
+
+		// Destruction is handled in DestroyGameObject()
+		// > Placement new doesn't work with the memory tracker's #define new
+#pragma push_macro("new")
+#undef new
+		GameObject* pObj = new( GetObjectStorage( index ) ) GameObject( type, newPos, collisionRadius, spriteId, id );
+#pragma pop_macro("new")
+		slot.denseIndex = static_cast<int>( denseObjects.size() );
+		slot.nextFree = -1;
+		slot.interpolate = false;
+		slot.creationOrder = nextCreationOrder++;
+		denseObjects.push_back( pObj );
+		denseObjectIds.push_back( id );
+		AddToTypeBucket( id, type );
+		slot.gridBucket = -1;
+		slot.gridPending = false;
+		MarkCollisionGridPending( id );
 		return id;
 	}
 
 	GameObject& GetGameObject( int ID )
 	{
-		if( objectMap.find( ID ) == objectMap.end() )
-			return noObject;
-
-		return objectMap.find( ID )->second;
+		GameObject* pObj = FindGameObject( ID );
+		return pObj ? *pObj : noObject;
 	}
 
 	GameObject& GetGameObjectByType( int type )
 	{
-		for( std::pair<const int, GameObject&>& i : objectMap )
-		{
-			if( i.second.type == type )
-				return i.second;
-		}
+		GameObjectIdView ids = GetGameObjectIDsByType( type );
+
+		if( ids.empty() )
+			return noObject;
 
-		return noObject;
+		return *FindGameObject( ids[0] );
 	}
 
 	std::vector<int> CollectGameObjectIDsByType( int type )
 	{
-		std::vector<int> vec;
-		for( std::pair<const int, GameObject&>& i : objectMap )
-		{
-			if( i.second.type == type )
-				vec.push_back( i.first );
-		}
-		return vec; // Returning a copy of the vector
+		GameObjectIdView ids = GetGameObjectIDsByType( type );
+		return std::vector<int>( ids.begin(), ids.end() ); // Returning a copy of the ids
+	}
+
+	GameObjectIdView GetGameObjectIDsByType( int type )
+	{
+		if( type < 0 || type >= static_cast<int>( typeBuckets.size() ) )
+			return {};
+
+		TypeBucket& bucket = typeBuckets[type];
+		CompactTypeBucket( bucket );
+
+		if( bucket.ids.empty() )
+			return {};
+
+#ifdef _DEBUG
+		for( int id : bucket.ids )
+			PLAY_ASSERT_MSG( FindGameObject( id )->type == type, "GameObject type changed directly: use Play::SetGameObjectType() instead" );
+#endif
+
+		return { bucket.ids.data(), bucket.ids.data() + bucket.ids.size() };
 	}
 
 	std::vector<int> CollectAllGameObjectIDs()
 	{
-		std::vector<int> vec;
+		// The dense array is in no particular order, so the copy is put back into creation order
+		std::vector<int> ids = denseObjectIds;
+		std::sort( ids.begin(), ids.end(), []( int a, int b ) { return objectSlots[a & OBJECT_INDEX_MASK].creationOrder < objectSlots[b & OBJECT_INDEX_MASK].creationOrder; } );
+		return ids;
+	}
+
+	void SetGameObjectType( GameObject& obj, int newType )
+	{
+		if( obj.type == -1 ) return; // Not for noObject
+		if( obj.type == newType ) return;
 
-		for( std::pair<const int, GameObject&>& i : objectMap )
-			vec.push_back( i.first );
+		int id = obj.GetId();
+		PLAY_ASSERT_MSG( FindGameObject( id ) == &obj, "SetGameObjectType can only be used with managed GameObjects" );
+		PLAY_ASSERT_MSG( newType >= 0, "GameObject types can't be negative" );
 
-		return vec; // Returning a copy of the vector
+		RemoveFromTypeBucket( id );
+		AddToTypeBucket( id, newType );
+		obj.type = newType;
 	}
 
 	void UpdateGameObject( GameObject& obj )
@@ -3973,11 +7631,13 @@ namespace Play
 		// Save the current position in case we need to go back
 		obj.oldPos = obj.pos;
 		obj.oldRot = obj.rotation;
+		SetInterpolate( obj );
 
 		// Move the object according to a very simple physical model
 		obj.velocity += obj.acceleration;
 		obj.pos += obj.velocity;
 		obj.rotation += obj.rotSpeed;
+		MoveInCollisionGrid( obj.GetId(), obj );
 
 		// Handle the animation frame update
 		obj.framePos += obj.animSpeed;
@@ -3990,15 +7650,42 @@ namespace Play
 
 	void DestroyGameObject( int ID )
 	{
-		if( objectMap.find( ID ) == objectMap.end() )
+		GameObject* go = FindGameObject( ID );
+
+		if( !go )
 		{
 			PLAY_ASSERT_MSG( false, "Unable to find object with given ID" );
 		}
 		else
 		{
-			GameObject* go = &objectMap.find( ID )->second;
-			delete go;
-			objectMap.erase( ID );
+			RemoveFromTypeBucket( ID );
+			RemoveFromCollisionGrid( ID & OBJECT_INDEX_MASK );
+
+			ObjectSlot& slot = objectSlots[ID & OBJECT_INDEX_MASK];
+
+			// Fill the gap in the dense arrays with the last object
+			int lastIndex = static_cast<int>( denseObjects.size() ) - 1;
+			denseObjects[slot.denseIndex] = denseObjects[lastIndex];
+			denseObjectIds[slot.denseIndex] = denseObjectIds[lastIndex];
+			objectSlots[denseObjectIds[lastIndex] & OBJECT_INDEX_MASK].denseIndex = slot.denseIndex;
+			denseObjects.pop_back();
+			denseObjectIds.pop_back();
+
+			// Invalidate the id and put the slot on the free list
+			slot.generation = ( slot.generation + 1 ) & OBJECT_GENERATION_MASK;
+			slot.denseIndex = -1;
+			slot.nextFree = -1;
+
+			int index = ID & OBJECT_INDEX_MASK;
+			if( lastFreeSlot >= 0 )
+				objectSlots[lastFreeSlot].nextFree = index;
+			else
+				firstFreeSlot = index;
+			lastFreeSlot = index;
+
+			slot.gridPending = false;
+
+			go->~GameObject();
 		}
 	}
 
@@ -4023,6 +7710,68 @@ namespace Play
 		return( ( xDiff * xDiff ) + ( yDiff * yDiff ) < radii * radii );
 	}
 
+	void MarkGameObjectMoved( GameObject& obj )
+	{
+		if( obj.type == -1 ) return; // Not for noObject
+		MarkCollisionGridPending( obj.GetId() );
+	}
+
+	GameObjectIdView QueryCollisions( GameObject& obj, unsigned int typeMask )
+	{
+		collisionResults.clear();
+
+		if( obj.type == -1 ) return {}; // Not for noObject
+
+		UpdateCollisionGrid();
+		VisitCollisionCandidates( obj, [&]( int denseIndex )
+		{
+			GameObject& other = *denseObjects[denseIndex];
+			if( &other != &obj && IsTypeInMask( other.type, typeMask ) && IsColliding( obj, other ) )
+				collisionResults.push_back( denseObjectIds[denseIndex] );
+		} );
+
+		return { collisionResults.data(), collisionResults.data() + collisionResults.size() };
+	}
+
+	void ForEachCollidingPair( int typeA, int typeB, const std::function<void( GameObject&, GameObject& )>& callback )
+	{
+		UpdateCollisionGrid();
+
+		// Find all of the pairs first so the callback is free to change the objects
+		collisionPairs.clear();
+		for( int idA : GetGameObjectIDsByType( typeA ) )
+		{
+			int denseIndexA = objectSlots[idA & OBJECT_INDEX_MASK].denseIndex;
+			GameObject& objA = *denseObjects[denseIndexA];
+
+			VisitCollisionCandidates( objA, [&]( int denseIndexB )
+			{
+				GameObject& objB = *denseObjects[denseIndexB];
+				if( objB.type != typeB || denseIndexB == denseIndexA )
+					return;
+				if( typeA == typeB && denseIndexB < denseIndexA )
+					return; // Already found the other way round
+				if( IsColliding( objA, objB ) )
+				{
+					collisionPairs.push_back( idA );
+					collisionPairs.push_back( denseObjectIds[denseIndexB] );
+				}
+			} );
+		}
+
+		// The callback could destroy objects, so look them up again and skip any that have gone
+		std::vector<int> pairs;
+		pairs.swap( collisionPairs );
+		for( size_t p = 0; p < pairs.size(); p += 2 )
+		{
+			GameObject* pObjA = FindGameObject( pairs[p] );
+			GameObject* pObjB = FindGameObject( pairs[p + 1] );
+			if( pObjA && pObjB )
+				callback( *pObjA, *pObjB );
+		}
+		pairs.swap( collisionPairs );
+	}
+
 	bool IsVisible( GameObject& obj )
 	{
 		if( obj.type == -1 ) return false; // Not for noObject
@@ -4099,7 +7848,11 @@ namespace Play
 
 	void SetSprite( GameObject& obj, const char* spriteName, float animSpeed )
 	{
-		int newSprite = PlayGraphics::Instance().GetSpriteId( spriteName );
+		SetSprite( obj, PlayGraphics::Instance().GetSpriteId( spriteName ), animSpeed );
+	}
+
+	void SetSprite( GameObject& obj, int newSprite, float animSpeed )
+	{
 		// Only reset the animation back to the start when it is new
 		if( newSprite != obj.spriteId )
 			obj.frame = 0;
@@ -4110,19 +7863,49 @@ namespace Play
 	void DrawObject( GameObject& obj )
 	{
 		if( obj.type == -1 ) return; // Don't draw noObject
-		PlayGraphics::Instance().Draw( obj.spriteId, obj.pos, obj.frame );
+		PlayGraphics::Instance().Draw( obj.spriteId, GetDrawPosition( obj ), obj.frame );
 	}
 
 	void DrawObjectTransparent( GameObject& obj, float opacity )
 	{
 		if( obj.type == -1 ) return; // Don't draw noObject
-		PlayGraphics::Instance().DrawTransparent( obj.spriteId, obj.pos, obj.frame, opacity );
+		PlayGraphics::Instance().DrawTransparent( obj.spriteId, GetDrawPosition( obj ), obj.frame, opacity );
 	}
 
 	void DrawObjectRotated( GameObject& obj, float opacity )
 	{
 		if( obj.type == -1 ) return; // Don't draw noObject
-		PlayGraphics::Instance().DrawRotated( obj.spriteId, obj.pos, obj.frame, obj.rotation, obj.scale, opacity );
+		float rotation = IsInterpolated( obj ) ? obj.oldRot + ( obj.rotation - obj.oldRot ) * fixedStepAlpha : obj.rotation;
+		PlayGraphics::Instance().DrawRotated( obj.spriteId, GetDrawPosition( obj ), obj.frame, rotation, obj.scale, opacity );
+	}
+
+	void SetFixedTimeStep( float timeStep )
+	{
+		PLAY_ASSERT_MSG( timeStep > 0.0f, "The fixed time step must be positive" );
+		fixedTimeStep = timeStep;
+	}
+
+	int AccumulateFixedSteps( float elapsedTime )
+	{
+		fixedStepAccumulator += elapsedTime;
+
+		// Drop any time over the maximum rather than trying to catch up, or slow steps would make each frame slower still
+		fixedStepAccumulator = std::min( fixedStepAccumulator, static_cast<double>( fixedTimeStep ) * MAX_FIXED_STEPS_PER_FRAME );
+
+		int steps = 0;
+		while( fixedStepAccumulator >= fixedTimeStep )
+		{
+			fixedStepAccumulator -= fixedTimeStep;
+			steps++;
+		}
+
+		fixedStepAlpha = static_cast<float>( fixedStepAccumulator / fixedTimeStep );
+		return steps;
+	}
+
+	float GetFixedStepAlpha()
+	{
+		return fixedStepAlpha;
 	}
 
 #endif